@@ -0,0 +1,560 @@
+#include "BigInt.h"
+#include "FixedBigInt.h"
+#include "ModInt.h"
+#include "StaticModInt.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Benchmark suite
+ *
+ * Every benchmark is a closure over pre-generated operands timed in batches: a warmup batch picks how
+ * many calls make up one sample (at least ~1ms worth), then samples are taken until the time budget
+ * runs out. Results are written as JSON, per call median, p99 and mean in nanoseconds plus ops/sec.
+ * Benchmarks over a set of inputs, such as exponents of different Hamming weight, time each input on
+ * its own and also report the spread of the per input medians: min, max and standard deviation.
+ *
+ * With --perf, one more batch per benchmark is run under hardware counters (Linux perf_event_open)
+ * to report cycles and instructions per call, IPC, L1d and last level cache read misses per limb and
+ * branch mispredicts per call. Counters that cannot be opened, because of the kernel, permissions
+ * (perf_event_paranoid) or a virtual machine without a PMU, are left out of the results.
+ *
+ * Usage: Bench [--out file] [--filter substring] [--max-bits n] [--budget seconds] [--seed n] [--perf]
+ * Progress goes to stderr, as some code paths in the library print to stdout.
+ */
+
+enum PerfCounter { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, PERF_COUNTERS };
+static const char * const perf_names[PERF_COUNTERS] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+struct BenchResult {
+    std::string name;
+    size_t bits;
+    size_t iterations;
+    size_t samples;
+    double median_ns;
+    double p99_ns;
+    double mean_ns;
+    //Per call, negative when not measured
+    double counters[PERF_COUNTERS];
+    //Spread of the per input medians, for benchmarks over several inputs
+    size_t inputs = 0;
+    double min_ns;
+    double max_ns;
+    double stddev_ns;
+};
+
+
+struct BenchConfig {
+    std::string out = "bench.json";
+    std::string filter;
+    size_t max_bits = 1 << 20;
+    double budget = 0.25;
+    unsigned long long seed = 1;
+    bool perf = false;
+};
+
+static BenchConfig config;
+
+static const std::pair<BigInt::MulKernel, const char *> mul_kernels[] = {
+    {BigInt::MulKernel::SCALAR, "scalar"}, {BigInt::MulKernel::AVX2, "avx2"}, {BigInt::MulKernel::AVX512, "avx512"}
+};
+static std::vector<BenchResult> results;
+
+//Keeps the optimizer from dropping the benchmarked calls
+static volatile limb_t sink;
+static void consume(const BigInt& n) {
+    sink = n.limbs[0];
+}
+
+/*
+ * One counting fd per event rather than a group, so that a machine missing some events still gets the
+ * others. Multiplexed counts are scaled by time enabled over time running.
+ */
+static int perf_fds[PERF_COUNTERS] = {-1, -1, -1, -1, -1};
+
+static void openPerfCounters() {
+#ifdef __linux__
+    const unsigned long long cache_read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const struct { unsigned type; unsigned long long config; } events[PERF_COUNTERS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cache_read_miss},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cache_read_miss},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    int opened = 0;
+    for(int i = 0; i < PERF_COUNTERS; ++i) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        perf_fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if(perf_fds[i] >= 0) {
+            ++opened;
+        } else {
+            std::cerr << "perf counter " << perf_names[i] << " unavailable: " << std::strerror(errno) << std::endl;
+        }
+    }
+    if(opened == 0) {
+        std::cerr << "no hardware counters available, continuing with timings only" << std::endl;
+    }
+#else
+    std::cerr << "hardware counters are only supported on Linux, continuing with timings only" << std::endl;
+#endif
+}
+
+//Runs f iterations times under the counters and stores the per call counts, or -1 for missing counters
+static void measurePerfCounters(const std::function<void()>& f, size_t iterations, double counters[PERF_COUNTERS]) {
+    for(int i = 0; i < PERF_COUNTERS; ++i) {
+        counters[i] = -1;
+    }
+#ifdef __linux__
+    for(int fd : perf_fds) {
+        if(fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    for(size_t i = 0; i < iterations; ++i) {
+        f();
+    }
+    for(int fd : perf_fds) {
+        if(fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for(int i = 0; i < PERF_COUNTERS; ++i) {
+        unsigned long long value[3];
+        if(perf_fds[i] < 0 || read(perf_fds[i], value, sizeof(value)) != sizeof(value) || value[2] == 0) {
+            continue;
+        }
+        counters[i] = static_cast<double>(value[0]) * value[1] / value[2] / iterations;
+    }
+#endif
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool selected(const std::string& name, size_t bits) {
+    if(bits > config.max_bits) {
+        return false;
+    }
+    return config.filter.empty() || name.find(config.filter) != std::string::npos;
+}
+
+//Times f into r's iterations, samples, median, p99 and mean
+static void measure(const std::function<void()>& f, double budget, BenchResult& r) {
+    //Warmup, which also sizes the batches
+    size_t iterations = 1;
+    while(true) {
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < iterations; ++i) {
+            f();
+        }
+        double t = secondsSince(start);
+        if(t >= 1e-3 || iterations >= (1 << 24)) {
+            break;
+        }
+        iterations *= t < 1e-5 ? 16 : 2;
+    }
+
+    std::vector<double> samples;
+    auto begin = std::chrono::steady_clock::now();
+    while(samples.size() < 3 || (secondsSince(begin) < budget && samples.size() < 1000)) {
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < iterations; ++i) {
+            f();
+        }
+        samples.push_back(secondsSince(start) * 1e9 / iterations);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for(auto s : samples) {
+        sum += s;
+    }
+    r.iterations = iterations;
+    r.samples = samples.size();
+    r.median_ns = samples[samples.size() / 2];
+    //Nearest rank
+    r.p99_ns = samples[std::min(samples.size() - 1, (samples.size() * 99 + 99) / 100 - 1)];
+    r.mean_ns = sum / samples.size();
+    for(int i = 0; i < PERF_COUNTERS; ++i) {
+        r.counters[i] = -1;
+    }
+}
+
+static void report(const BenchResult& r) {
+    std::cerr << std::left << std::setw(20) << r.name << std::right << std::setw(9) << r.bits << " bits "
+        << std::setw(14) << std::fixed << std::setprecision(1) << r.median_ns << " ns  p99 "
+        << std::setw(14) << r.p99_ns << " ns";
+    if(r.counters[CYCLES] >= 0 && r.counters[INSTRUCTIONS] >= 0) {
+        std::cerr << "  ipc " << std::setprecision(2) << r.counters[INSTRUCTIONS] / r.counters[CYCLES];
+    }
+    if(r.inputs > 0) {
+        std::cerr << "  max/min " << std::setprecision(3) << r.max_ns / r.min_ns
+            << "  stddev " << std::setprecision(1) << r.stddev_ns << " ns";
+    }
+    std::cerr << std::endl;
+}
+
+static void bench(const std::string& name, size_t bits, std::function<void()> f) {
+    if(!selected(name, bits)) {
+        return;
+    }
+    BenchResult r;
+    r.name = name;
+    r.bits = bits;
+    measure(f, config.budget, r);
+    if(config.perf) {
+        measurePerfCounters(f, r.iterations, r.counters);
+    }
+    results.push_back(r);
+    report(r);
+}
+
+/*
+ * One benchmark over several inputs, each timed on its own with an even share of the budget. The median,
+ * p99 and mean are over the per input medians, and min, max and standard deviation give their spread.
+ */
+static void benchInputs(const std::string& name, size_t bits, const std::vector<std::function<void()>>& fs) {
+    if(!selected(name, bits)) {
+        return;
+    }
+    BenchResult r;
+    r.name = name;
+    r.bits = bits;
+    r.iterations = 0;
+    r.samples = 0;
+    std::vector<double> medians;
+    for(auto& f : fs) {
+        BenchResult input;
+        measure(f, config.budget / fs.size(), input);
+        medians.push_back(input.median_ns);
+        r.iterations = r.iterations == 0 ? input.iterations : std::min(r.iterations, input.iterations);
+        r.samples += input.samples;
+    }
+
+    std::sort(medians.begin(), medians.end());
+    double sum = 0, sum_sq = 0;
+    for(auto m : medians) {
+        sum += m;
+        sum_sq += m * m;
+    }
+    r.inputs = medians.size();
+    r.median_ns = medians[medians.size() / 2];
+    r.p99_ns = medians[std::min(medians.size() - 1, (medians.size() * 99 + 99) / 100 - 1)];
+    r.mean_ns = sum / medians.size();
+    r.min_ns = medians.front();
+    r.max_ns = medians.back();
+    r.stddev_ns = std::sqrt(std::max(0.0, sum_sq / medians.size() - r.mean_ns * r.mean_ns));
+    for(int i = 0; i < PERF_COUNTERS; ++i) {
+        r.counters[i] = -1;
+    }
+    results.push_back(r);
+    report(r);
+}
+
+static const char * kernelName(BigInt::MulKernel k) {
+    for(auto& kernel : mul_kernels) {
+        if(kernel.first == k) {
+            return kernel.second;
+        }
+    }
+    return "unknown";
+}
+
+static void writeJson() {
+    std::ofstream out(config.out);
+    out << "{\n  \"seed\": " << config.seed << ",\n  \"perf_counters\": " << (config.perf ? "true" : "false")
+        << ",\n  \"kernel\": \"" << kernelName(BigInt::mulKernel()) << "\",\n  \"benchmarks\": [\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"bits\": " << r.bits
+            << ", \"iterations\": " << r.iterations << ", \"samples\": " << r.samples
+            << std::fixed << std::setprecision(1)
+            << ", \"median_ns\": " << r.median_ns << ", \"p99_ns\": " << r.p99_ns << ", \"mean_ns\": " << r.mean_ns
+            << ", \"ops_per_sec\": " << 1e9 / r.median_ns;
+        if(r.inputs > 0) {
+            out << ", \"inputs\": " << r.inputs << ", \"min_ns\": " << r.min_ns << ", \"max_ns\": " << r.max_ns
+                << ", \"stddev_ns\": " << r.stddev_ns << std::setprecision(3) << ", \"max_min_ratio\": " << r.max_ns / r.min_ns;
+        }
+        if(config.perf) {
+            //Limbs of the operand size, for the per limb cache figures
+            double limbs = (r.bits + 30) / 31;
+            const double * c = r.counters;
+            out << std::setprecision(3);
+            for(int k = 0; k < PERF_COUNTERS; ++k) {
+                if(c[k] < 0) {
+                    continue;
+                }
+                bool per_limb = k == L1D_MISSES || k == LLC_MISSES;
+                out << ", \"" << perf_names[k] << (per_limb ? "_per_limb" : "_per_call") << "\": " << (per_limb ? c[k] / limbs : c[k]);
+            }
+            if(c[CYCLES] > 0 && c[INSTRUCTIONS] >= 0) {
+                out << ", \"ipc\": " << c[INSTRUCTIONS] / c[CYCLES];
+            }
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+//An odd number of exactly bits bits
+static BigInt oddOperand(size_t bits, RandomGenerator& rng) {
+    BigInt n = BigInt::genRandomBits(bits - 1, rng);
+    n.setBit(bits - 1);
+    n.setBit(0);
+    return n;
+}
+
+//bits bits with the top one and weight - 1 others set
+static BigInt weightedExponent(size_t bits, size_t weight, RandomGenerator& rng) {
+    std::vector<size_t> positions;
+    for(size_t i = 0; i + 1 < bits; ++i) {
+        positions.push_back(i);
+    }
+    //Partial Fisher-Yates for weight - 1 distinct positions
+    BigInt e = BigInt::ZERO;
+    e.setBit(bits - 1);
+    for(size_t i = 0; i + 1 < weight; ++i) {
+        size_t j = i + rng.next() % (positions.size() - i);
+        std::swap(positions[i], positions[j]);
+        e.setBit(positions[i]);
+    }
+    return e;
+}
+
+static const size_t SIZES[] = {64, 256, 1024, 4096, 16384, 65536, 262144, 1048576};
+
+static void benchArithmetic(RandomGenerator& rng) {
+    for(size_t bits : SIZES) {
+        BigInt a = oddOperand(bits, rng), b = oddOperand(bits, rng);
+        bench("add", bits, [&]() { BigInt r(a); r += b; consume(r); });
+        bench("sub", bits, [&]() { BigInt r(a); r -= b; consume(r); });
+        bench("shift", bits, [&]() { consume(a << 17); });
+    }
+}
+
+static void benchMultiplication(RandomGenerator& rng) {
+    for(size_t bits : SIZES) {
+        BigInt a = oddOperand(bits, rng), b = oddOperand(bits, rng);
+        //operator* picks schoolbook or Karatsuba by size, naiveMul is always schoolbook
+        bench("mul", bits, [&]() { consume(a * b); });
+        bench("sqr", bits, [&]() { consume(a * a); });
+        if(bits <= 65536) {
+            bench("mul_schoolbook", bits, [&]() { consume(a.naiveMul(a, b)); });
+        }
+    }
+
+    //Each kernel the processor supports at 16, 32 and 64 limbs, the sizes Karatsuba and division bottom out in
+    BigInt::MulKernel original = BigInt::mulKernel();
+    for(auto& kernel : mul_kernels) {
+        if(!BigInt::setMulKernel(kernel.first)) {
+            continue;
+        }
+        for(size_t bits : {496, 992, 1984}) {
+            BigInt a = oddOperand(bits, rng), b = oddOperand(bits, rng);
+            bench(std::string("mul_basecase.") + kernel.second, bits, [&]() { consume(a.naiveMul(a, b)); });
+            bench(std::string("sqr_basecase.") + kernel.second, bits, [&]() { consume(a.naiveMul(a, a)); });
+        }
+    }
+    BigInt::setMulKernel(original);
+}
+
+static void benchDivision(RandomGenerator& rng) {
+    for(size_t bits : SIZES) {
+        if(bits > 262144) {
+            break;
+        }
+        BigInt num = oddOperand(2 * bits, rng), denom = oddOperand(bits, rng);
+        bench("div", bits, [&]() { consume(num / denom); });
+        bench("mod", bits, [&]() { consume(num % denom); });
+        bench("div_word", bits, [&]() { consume(num / BigInt(1000000007)); });
+    }
+}
+
+static void benchConversions(RandomGenerator& rng) {
+    for(size_t bits : SIZES) {
+        if(bits > 65536) {
+            break;
+        }
+        BigInt a = oddOperand(bits, rng);
+        std::string decimal = a.ToDecimal();
+        bench("to_decimal", bits, [&]() { sink = a.ToDecimal().size(); });
+        bench("from_decimal", bits, [&]() { consume(BigInt(decimal)); });
+        bench("to_binary", bits, [&]() { sink = a.ToBinary().size(); });
+    }
+}
+
+static void benchGcd(RandomGenerator& rng) {
+    for(size_t bits : SIZES) {
+        BigInt a = oddOperand(bits, rng), b = oddOperand(bits, rng);
+        if(bits <= 262144) {
+            bench("gcd", bits, [&]() { consume(a.gcd(b)); });
+        }
+        if(bits <= 65536) {
+            bench("mod_inv", bits, [&]() { consume(a.mod_inv(b)); });
+        }
+        if(bits <= 4096) {
+            bench("mont_inv", bits, [&]() { consume(a.mont_inv(b)); });
+            std::vector<BigInt> xs;
+            for(int i = 0; i < 64; ++i) {
+                xs.push_back(BigInt::genRandomNum(b, rng));
+            }
+            //Time for the whole batch of 64
+            bench("batch_mod_inv_64", bits, [&]() { std::vector<BigInt> ys(xs); BigInt::batchModInv(ys, b); consume(ys[0]); });
+        }
+    }
+}
+
+static void benchModExp(RandomGenerator& rng) {
+    for(size_t bits : {256, 512, 1024, 2048, 4096}) {
+        BigInt mod = oddOperand(bits, rng);
+        BigInt base = BigInt::genRandomNum(mod, rng);
+        BigInt exp = oddOperand(bits, rng);
+        bench("modexp", bits, [&]() { consume(base.pow(exp, mod)); });
+        bench("modexp_ct", bits, [&]() { consume(base.pow_ct(exp, mod)); });
+        //Exponents of Hamming weight 1 up to bits, whose spread should be flat for pow_ct
+        std::vector<BigInt> weighted;
+        for(size_t weight : {size_t(1), bits / 8, bits / 4, bits / 2, 3 * bits / 4, bits}) {
+            weighted.push_back(weightedExponent(bits, weight, rng));
+        }
+        std::vector<std::function<void()>> pows, pows_ct;
+        for(auto& e : weighted) {
+            pows.push_back([&]() { consume(base.pow(e, mod)); });
+            pows_ct.push_back([&]() { consume(base.pow_ct(e, mod)); });
+        }
+        benchInputs("modexp_weights", bits, pows);
+        benchInputs("modexp_ct_weights", bits, pows_ct);
+        bench("modexp_65537", bits, [&]() { consume(base.pow(BigInt(65537), mod)); });
+        bench("pow2mod", bits, [&]() { consume(BigInt::pow2mod(exp, mod)); });
+        if(bits <= 2048) {
+            std::vector<BigInt> bases, exps;
+            for(int i = 0; i < 8; ++i) {
+                bases.push_back(BigInt::genRandomNum(mod, rng));
+                exps.push_back(oddOperand(bits, rng));
+            }
+            //Time for the whole batch of 8
+            bench("modexp_batch_8", bits, [&]() { consume(BigInt::powBatch(bases, exps, mod)[0]); });
+        }
+    }
+    //Moduli next to a power of two reduce by folding
+    for(size_t bits : {521, 1279, 2203}) {
+        BigInt mod = (BigInt::ONE << bits) - BigInt::ONE;
+        BigInt base = BigInt::genRandomNum(mod, rng);
+        BigInt exp = oddOperand(bits, rng);
+        bench("modexp_mersenne", bits, [&]() { consume(base.pow(exp, mod)); });
+    }
+}
+
+template<size_t Bits>
+static void benchFixed(RandomGenerator& rng) {
+    BigInt mod = oddOperand(Bits, rng);
+    BigInt a = BigInt::genRandomNum(mod, rng), b = BigInt::genRandomNum(mod, rng);
+    FixedMontgomery<Bits> ring(mod);
+    FixedBigInt<Bits> fa = ring.toMont(a), fb = ring.toMont(b);
+    bench("mod_mul", Bits, [&]() { consume(a.mod_mul(b, mod)); });
+    bench("fixed_mul", Bits, [&]() { sink = fa.mul(fb).limbs[0]; });
+    bench("fixed_sqr", Bits, [&]() { sink = fa.sqr().limbs[0]; });
+    bench("fixed_mont_mul", Bits, [&]() { sink = ring.mul(fa, fb).limbs[0]; });
+}
+
+//The same product in a runtime ModRing and with the modulus known at compile time
+template<class Field>
+static void benchStatic(const std::string& field, RandomGenerator& rng) {
+    typedef StaticModInt<Field> Elem;
+    BigInt mod = Elem::modulus();
+    BigInt a = BigInt::genRandomNum(mod, rng), b = BigInt::genRandomNum(mod, rng);
+    ModRing ring(mod);
+    ModInt ra = ring(a), rb = ring(b);
+    Elem sa(a), sb(b);
+    bench("modint_mul." + field, Elem::BITS, [&]() { sink = (ra * rb).isZero(); });
+    bench("static_mul." + field, Elem::BITS, [&]() { sink = (sa * sb).isZero(); });
+}
+
+static void benchPrimes(RandomGenerator& rng) {
+    for(size_t bits : {256, 512, 1024}) {
+        BigInt low = BigInt::ONE << (bits - 1), high = BigInt::ONE << bits;
+        BigInt p = BigInt::genLikelyPrime(low, high);
+        bench("miller_rabin", bits, [&]() { sink = p.millerRabinLikelyPrime(); });
+        bench("gen_likely_prime", bits, [&]() { consume(BigInt::genLikelyPrime(low, high)); });
+        bench("gen_provable_prime", bits, [&]() { consume(BigInt::genPrime(low, high)); });
+    }
+}
+
+int main(int argc, char ** argv) {
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--perf") {
+            config.perf = true;
+            continue;
+        }
+        if(i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << std::endl;
+            return 1;
+        }
+        if(arg == "--out") {
+            config.out = argv[++i];
+        } else if(arg == "--filter") {
+            config.filter = argv[++i];
+        } else if(arg == "--max-bits") {
+            config.max_bits = std::strtoull(argv[++i], nullptr, 10);
+        } else if(arg == "--budget") {
+            config.budget = std::atof(argv[++i]);
+        } else if(arg == "--seed") {
+            config.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if(config.perf) {
+        openPerfCounters();
+    }
+    RandomGenerator rng(config.seed);
+    BigInt::threadRandom().seed(config.seed);
+
+    benchArithmetic(rng);
+    benchMultiplication(rng);
+    benchDivision(rng);
+    benchConversions(rng);
+    benchGcd(rng);
+    benchModExp(rng);
+    benchFixed<256>(rng);
+    benchFixed<512>(rng);
+    benchFixed<1024>(rng);
+    benchFixed<2048>(rng);
+    benchFixed<3072>(rng);
+    benchFixed<4096>(rng);
+    benchStatic<Curve25519Field>("curve25519", rng);
+    benchStatic<Secp256k1Field>("secp256k1", rng);
+    benchStatic<P256Field>("p256", rng);
+    benchStatic<P521Field>("p521", rng);
+    benchPrimes(rng);
+
+    writeJson();
+    if(BigIntStats::enabled()) {
+        BigIntStats::dump(std::cerr);
+    }
+    std::cerr << "wrote " << results.size() << " results to " << config.out << std::endl;
+    return 0;
+}
@@ -9,9 +9,101 @@
 #include <bitset>
 #include <algorithm>
 #include <chrono>
+#include <random>
+#include <array>
+#include <cstdint>
 
 typedef unsigned long long limb_t;
 
+struct PocklingtonStep;
+
+/*
+ * ChaCha20 keystream generator. Not shared between threads: BigInt keeps one per thread, and objects
+ * can own their own, seeded for reproducible runs.
+ */
+class RandomGenerator {
+    public:
+	RandomGenerator();
+	explicit RandomGenerator(unsigned long long seed);
+	//The raw ChaCha20 keystream for a key and 64 bit nonce, starting at block counter
+	RandomGenerator(const uint32_t key[8], unsigned long long nonce, unsigned long long counter);
+
+	void seed(unsigned long long seed);
+	uint32_t next();
+	void fill(limb_t * out, size_t n, int bits);
+
+    private:
+	void setKey(const uint32_t key[8]);
+	void refill();
+
+	std::array<uint32_t, 16> state;
+	std::array<uint32_t, 16> block;
+	size_t used;
+};
+
+/*
+ * Per-routine instrumentation, compiled in with -D_BIGINT_STATS and free otherwise (the counters then
+ * stay at zero). Each instrumented routine counts its calls, the limbs of its operands, heap allocations
+ * made while it is the innermost instrumented routine on the thread, and its self cycles: time spent
+ * in instrumented callees is charged to them, so nested and recursive routines are not double counted.
+ */
+struct OpStats {
+	unsigned long long calls;
+	unsigned long long limbs;
+	unsigned long long allocations;
+	unsigned long long cycles;
+};
+
+class BigIntStats {
+    public:
+	enum Op {
+	    MUL_SCHOOLBOOK, MUL_BASECASE, MUL_KARATSUBA, DIV_WORD, DIV_KNUTH,
+	    TO_DECIMAL, FROM_STRING, GCD, HALF_GCD, INV_LEHMER, INV_BINARY, INV_BATCH,
+	    MONT_MUL, MODEXP_LADDER, MODEXP_SLIDING, MODEXP_FIXED, MODEXP_POW2, MODEXP_BATCH, MILLER_RABIN, LUCAS_LEHMER, PROTH,
+	    RANDOM_BITS,
+	    OP_COUNT
+	};
+	typedef std::array<OpStats, OP_COUNT> Snapshot;
+
+	static bool enabled();
+	static const char * name(Op op);
+	static Snapshot snapshot();
+	static void reset();
+	static void dump(std::ostream& out);
+	static void dump(std::ostream& out, const Snapshot& stats);
+
+	//Times the enclosing block, see BIGINT_STATS_SCOPE
+	class Scope {
+	    public:
+		Scope(Op op, size_t limbs);
+		~Scope();
+	    private:
+		friend class BigIntStats;
+		Op op;
+		Scope * parent;
+		unsigned long long start;
+		unsigned long long children;
+	};
+	static void countAllocation();
+};
+
+//Read-only view of consecutive limbs, valid until the BigInt it points into is modified
+struct LimbRange {
+	const limb_t * first;
+	const limb_t * last;
+
+	size_t size() const { return last - first; }
+	const limb_t * begin() const { return first; }
+	const limb_t * end() const { return last; }
+	const limb_t& operator[](size_t i) const { return first[i]; }
+};
+
+#ifdef _BIGINT_STATS
+#define BIGINT_STATS_SCOPE(op, limbs) BigIntStats::Scope bigint_stats_scope(BigIntStats::op, (limbs))
+#else
+#define BIGINT_STATS_SCOPE(op, limbs)
+#endif
+
 class BigInt {
 
     
@@ -42,13 +134,26 @@ class BigInt {
 
 
 	BigInt& operator=(BigInt rhs);
-	BigInt operator+(const BigInt& rhs) const;
+	//Overloads taking an rvalue work in its buffer instead of copying an operand
+	BigInt operator+(const BigInt& rhs) const &;
+	BigInt operator+(const BigInt& rhs) &&;
+	BigInt operator+(BigInt&& rhs) const &;
+	BigInt operator+(BigInt&& rhs) &&;
 	BigInt operator++(int);
-	BigInt operator-(const BigInt& rhs) const;
-	BigInt operator/(const BigInt& rhs) const;
-	BigInt operator*(const BigInt& rhs) const;
-	BigInt operator*(const limb_t& rhs) const;
-	BigInt operator%(const BigInt& rhs) const;
+	BigInt operator-(const BigInt& rhs) const &;
+	BigInt operator-(const BigInt& rhs) &&;
+	BigInt operator-(BigInt&& rhs) const &;
+	BigInt operator-(BigInt&& rhs) &&;
+	BigInt operator/(const BigInt& rhs) const &;
+	BigInt operator/(const BigInt& rhs) &&;
+	BigInt operator*(const BigInt& rhs) const &;
+	BigInt operator*(const BigInt& rhs) &&;
+	BigInt operator*(BigInt&& rhs) const &;
+	BigInt operator*(BigInt&& rhs) &&;
+	BigInt operator*(const limb_t& rhs) const &;
+	BigInt operator*(const limb_t& rhs) &&;
+	BigInt operator%(const BigInt& rhs) const &;
+	BigInt operator%(const BigInt& rhs) &&;
 	BigInt& operator+=(const BigInt& rhs);
 	BigInt& operator++();
 	BigInt& operator*=(const BigInt& rhs);
@@ -56,7 +161,8 @@ class BigInt {
 	BigInt& operator/=(const BigInt& rhs);
 	BigInt& operator%=(const BigInt& rhs);
 	BigInt& operator-=(const BigInt& rhs);
-	BigInt operator-() const;
+	BigInt operator-() const &;
+	BigInt operator-() &&;
 
 	bool operator==(const BigInt& rhs) const;
 	bool operator!=(const BigInt& rhs) const;
@@ -69,73 +175,264 @@ class BigInt {
    	BigInt gcd(const BigInt& rhs) const;
 	static limb_t log2(const limb_t);
 	static BigInt log2(const BigInt&);
+
+	//Bit queries
+	size_t bitLength() const;
+	size_t countTrailingZeros() const;
+	size_t popcount() const;
+	bool testBit(size_t i) const;
+	BigInt& setBit(size_t i);
+	BigInt& clearBit(size_t i);
+	bool isOdd() const;
+	bool isZero() const;
+	int sign() const;
+
 	BigInt& lshift(int);
     BigInt& rshift(int);
 	BigInt& lLimbShift(int);
 	BigInt& rLimbShift(int);
+	BigInt operator<<(int) const;
+	BigInt operator>>(int) const;
+	BigInt& operator<<=(int);
+	BigInt& operator>>=(int);
+	BigInt& addShifted(const BigInt& rhs, int shift);
+	BigInt& subShifted(const BigInt& rhs, int shift);
+	//Fused multiply-accumulate, *this += a * b and *this -= a * b without forming the product
+	BigInt& addmul(const BigInt& a, const BigInt& b);
+	BigInt& submul(const BigInt& a, const BigInt& b);
+	BigInt& addmul_1(const BigInt& a, limb_t b);
+	BigInt& submul_1(const BigInt& a, limb_t b);
 	
 	BigInt pow(BigInt exp) const;
 	BigInt abs(const BigInt&) const;
 
     //Random num generation
+	static RandomGenerator& threadRandom();
+	static BigInt genRandomBits(size_t bits);
+	static BigInt genRandomBits(size_t bits, RandomGenerator& rng);
 	static BigInt genRandomBits(const BigInt& bits);
 	static BigInt genRandomNum(const BigInt& high);
+	static BigInt genRandomNum(const BigInt& high, RandomGenerator& rng);
 	static BigInt genRandomNum(const BigInt& low, const BigInt& high);
+	static BigInt genRandomNum(const BigInt& low, const BigInt& high, RandomGenerator& rng);
 
     //prime checking
     bool checkFermatWitness(const BigInt& witness) const;
     bool checkMillerRabinWitness(const BigInt& witness) const;
     bool millerRabinLikelyPrime(int k = 10) const;
     static bool isLikelyPrime(const BigInt& num);
+    //Deterministic tests for 2^p - 1, k 2^n + 1 with odd k < 2^n, and 2^(2^m) + 1 with m < 31
+    static bool isMersennePrime(size_t p);
+    static bool isProthPrime(const BigInt& k, size_t n);
+    static bool isFermatPrime(size_t m);
 	static BigInt genLikelyPrime(const BigInt& low, const BigInt& high);
-	static BigInt genPrime(const BigInt& low,  const BigInt& high);
+	static BigInt genPrime(const BigInt& low,  const BigInt& high, std::vector<PocklingtonStep> * certificate = nullptr);
+	static bool verifyPrimeCertificate(const std::vector<PocklingtonStep>& certificate);
 
 	BigInt mod_add(const BigInt& add, const BigInt& mod) const;
 	BigInt mod_sub(const BigInt& sub, const BigInt& mod) const;
+	BigInt mod_neg(const BigInt& mod) const;
+	BigInt mod_double(const BigInt& mod) const;
+	//In place, for *this and the operand already in [0, mod)
+	BigInt& addReduced(const BigInt& add, const BigInt& mod);
+	BigInt& subReduced(const BigInt& sub, const BigInt& mod);
+	BigInt& negReduced(const BigInt& mod);
+	BigInt& doubleReduced(const BigInt& mod);
 	BigInt mod_mul(const BigInt& mul, const BigInt& mod) const;
 	BigInt mod_inv(const BigInt& mod) const;
+	BigInt mont_inv(const BigInt& mod) const;
+	static std::vector<size_t> batchModInv(std::vector<BigInt>& xs, const BigInt& mod);
 	BigInt mod_sqr(const BigInt& mod) const;
 	BigInt pow(const BigInt& exp, const BigInt& mod) const;
+	BigInt pow_ct(const BigInt& exp, const BigInt& mod) const;
+	static BigInt pow2mod(const BigInt& exp, const BigInt& mod);
+	//bases[i]^exps[i] mod mods[i] in [0, mods[i]), running several odd moduli of the same size side by side in vector lanes
+	static std::vector<BigInt> powBatch(const std::vector<BigInt>& bases, const std::vector<BigInt>& exps, const BigInt& mod);
+	static std::vector<BigInt> powBatch(const std::vector<BigInt>& bases, const std::vector<BigInt>& exps,
+		const std::vector<BigInt>& mods);
+
+	BigInt naiveMul(const BigInt& n1, const BigInt& n2) const;
 
-	BigInt naiveMul(const BigInt& n1, const BigInt& n2);
+	//Schoolbook multiplication kernels, the widest one the processor supports is used unless another is picked
+	enum class MulKernel { SCALAR, AVX2, AVX512 };
+	static MulKernel mulKernel();
+	//False if the processor does not support k, leaving the kernel as it was
+	static bool setMulKernel(MulKernel k);
     
     private:
+	friend class ModRing;
 	limb_t base;    
+	BigInt(const BigInt& b, size_t capacity);
 	void CtorHelper(limb_t ull);
+	//|*this| += |rhs| and |*this| -= |rhs|, the sign of *this flipping if the subtraction goes below 0
+	void addMagnitude(const BigInt& rhs);
+	void subMagnitude(const BigInt& rhs);
 	void reallign();
 	limb_t getBits(limb_t lt, int bits);
 
 	//Multiplication
-    	BigInt karatsuba(const BigInt& n1, const BigInt& n2);
+	static limb_t addmul_1(limb_t * dst, const limb_t * a, size_t n, limb_t b);
+	static limb_t submul_1(limb_t * dst, const limb_t * a, size_t n, limb_t b);
+	void mulAccumulate(const BigInt& a, const BigInt& b, bool product_negative);
+	//dst[0, n + m) = a[0, n) * b[0, m) and dst[0, 2n) = a[0, n)^2, normalised
+	static void mulBasecase(limb_t * dst, const limb_t * a, size_t n, const limb_t * b, size_t m);
+	static void sqrBasecase(limb_t * dst, const limb_t * a, size_t n);
+    	BigInt karatsuba(const BigInt& n1, const BigInt& n2) const;
 	void karatsuba(const std::vector<limb_t>& n1, const std::vector<limb_t>& n2, std::vector<limb_t>& scratch, 
 			unsigned scratch_offset, unsigned n1l_offset, unsigned n1_size, 
-			unsigned n2l_offset, unsigned n2_size );
+			unsigned n2l_offset, unsigned n2_size ) const;
 	
 	void naiveMul(std::vector<limb_t>::const_iterator n1, std::vector<limb_t>::const_iterator n2, 
-			std::vector<limb_t>::iterator scratch, unsigned n1_size, unsigned n2_size );
+			std::vector<limb_t>::iterator scratch, unsigned n1_size, unsigned n2_size ) const;
 	//BigInt naiveMul(const BigInt& n1, const BigInt& n2);
 	BigInt naiveMul(const BigInt& n1, const limb_t& n2);
 
 	//Division
 	void div(BigInt * dv, const BigInt& num, const limb_t& denom, BigInt * rem) const;
 	void div(BigInt * dv, const BigInt& num, const BigInt& denom, BigInt * rem) const;
+	bool reduceSpecialForm(const BigInt& mod);
 
 	//Exponentiation
 	static BigInt modexp_sliding_window(const BigInt& base, const BigInt& exp, const BigInt& mod, int k = 5);
 	static BigInt modexp_montgomery(const BigInt& base, const BigInt& exp, const BigInt& mod);
+	static BigInt modexp_fixed_window(const BigInt& base, const BigInt& exp, const BigInt& mod, int k);
+
+	//Montgomery multiplication, R = 2^(bits * mod.size())
+	static limb_t montInverse(const BigInt& mod);
+	static void montMul(const std::vector<limb_t>& a, const std::vector<limb_t>& b, const BigInt& mod, limb_t inv,
+			std::vector<limb_t>& out);
+	//The same on independent operands side by side, limb j of lane l at [j * lanes + l], t holding (n + 1) lanes limbs
+	static size_t montLanes(MulKernel kernel);
+	static void montMulLanes(MulKernel kernel, const limb_t * a, const limb_t * b, const limb_t * mod, const limb_t * inv,
+			size_t n, limb_t * t);
+	static void powLanes(const std::vector<BigInt>& bases, const std::vector<BigInt>& exps, const std::vector<BigInt>& mods,
+			const size_t * idx, size_t count, MulKernel kernel, std::vector<BigInt>& results);
 
 	//Limb manipulation
-	BigInt highLimb() const;
-	BigInt highNLimbs(int n) const;
-	BigInt lowerLimbs() const;
-	BigInt lowerNLimbs(int n) const;
-	BigInt getLimbsRange(int start, int end) const;
+	LimbRange highLimb() const;
+	LimbRange highNLimbs(int n) const;
+	LimbRange lowerLimbs() const;
+	LimbRange lowerNLimbs(int n) const;
+	LimbRange getLimbsRange(int start, int end) const;
+
+	//GCD
+	static limb_t binaryGcd(limb_t u, limb_t v);
+	static bool lehmerMatrix(const BigInt& a, const BigInt& b, long long m[4]);
+	static void applyLehmerMatrix(BigInt& a, BigInt& b, const long long m[4]);
+	static void applyCofactorMatrix(BigInt& u, BigInt& v, const long long m[4]);
+	static void lehmerReduce(BigInt& a, BigInt& b, size_t m, BigInt * n);
+	static void halfGcd(BigInt& a, BigInt& b, BigInt * n);
+	static BigInt lehmerInverse(const BigInt& x, const BigInt& mod);
+	static BigInt binaryInverse(const BigInt& x, const BigInt& mod, const BigInt& start);
 
+	//Prime generation
+	static bool isSmallPrime(limb_t n);
+	static limb_t genSmallPrime(limb_t low, limb_t high);
+	static bool checkPocklington(const BigInt& p, const BigInt& q, const BigInt& a);
     
 };
 
+/*
+ * One link of a Pocklington certificate: q is a proven prime with q > sqrt(p) - 1, q | p - 1,
+ * a^(p-1) = 1 mod p and gcd(a^((p-1)/q) - 1, p) = 1, which together prove that p is prime.
+ * Links with q == 0 are small enough (< 2^32) to be checked directly by trial division.
+ */
+struct PocklingtonStep {
+	BigInt p;
+	BigInt q;
+	BigInt a;
+};
+
 std::ostream& operator<<(std::ostream &strm, const BigInt& bn);
 
+/*
+ * Integer literal parsed at compile time into BigInt's 31 bit limbs, least significant first. Written as
+ * 1234..._big, 0x1f..._big, 0b101..._big or 0777..._big with optional ' separators; every distinct literal
+ * lives once in static storage and a digit the base does not have fails to compile.
+ */
+template<size_t N>
+struct BigLiteral {
+	limb_t limbs[N];
+	size_t used;
+
+	operator BigInt() const {
+	    BigInt n;
+	    n.limbs.assign(limbs, limbs + used);
+	    return n;
+	}
+};
+
+//Upper bound on the limbs of a literal, from the bits each digit of its base can add
+constexpr size_t bigLiteralLimbs(const char * s, size_t len) {
+    size_t digit_bits = 10, prefix = 0;
+    if(len > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+	digit_bits = 12;
+	prefix = 2;
+    } else if(len > 2 && s[0] == '0' && (s[1] == 'b' || s[1] == 'B')) {
+	digit_bits = 3;
+	prefix = 2;
+    } else if(len > 1 && s[0] == '0') {
+	digit_bits = 9;
+	prefix = 1;
+    }
+    //In thirds of a bit, log2(10) < 10/3
+    return ((len - prefix) * digit_bits / 3) / 31 + 1;
+}
+
+template<size_t N>
+constexpr BigLiteral<N> parseBigLiteral(const char * s, size_t len) {
+    BigLiteral<N> r{};
+    limb_t radix = 10;
+    size_t i = 0;
+    if(len > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+	radix = 16;
+	i = 2;
+    } else if(len > 2 && s[0] == '0' && (s[1] == 'b' || s[1] == 'B')) {
+	radix = 2;
+	i = 2;
+    } else if(len > 1 && s[0] == '0') {
+	radix = 8;
+	i = 1;
+    }
+    for(; i < len; ++i) {
+	char c = s[i];
+	if(c == '\'') {
+	    continue;
+	}
+	limb_t digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 99;
+	if(digit >= radix) {
+	    throw "invalid digit in _big literal";
+	}
+	limb_t carry = digit;
+	for(size_t k = 0; k < N; ++k) {
+	    limb_t t = r.limbs[k] * radix + carry;
+	    r.limbs[k] = t & 0x7fffffff;
+	    carry = t >> 31;
+	}
+    }
+    r.used = N;
+    while(r.used > 1 && r.limbs[r.used - 1] == 0) {
+	--r.used;
+    }
+    return r;
+}
+
+template<char... Cs>
+struct BigLiteralStorage {
+	static constexpr char digits[sizeof...(Cs)] = {Cs...};
+	static constexpr size_t N = bigLiteralLimbs(digits, sizeof...(Cs));
+	static constexpr BigLiteral<N> value = parseBigLiteral<N>(digits, sizeof...(Cs));
+};
+
+template<char... Cs> constexpr char BigLiteralStorage<Cs...>::digits[sizeof...(Cs)];
+template<char... Cs> constexpr size_t BigLiteralStorage<Cs...>::N;
+template<char... Cs> constexpr BigLiteral<BigLiteralStorage<Cs...>::N> BigLiteralStorage<Cs...>::value;
+
+template<char... Cs>
+constexpr const BigLiteral<BigLiteralStorage<Cs...>::N>& operator"" _big() {
+    return BigLiteralStorage<Cs...>::value;
+}
+
 
 
 #endif
@@ -1,4 +1,5 @@
 #include "BigInt.h"
+#include "ModInt.h"
 #include <assert.h>
 
 const BigInt BigInt::ZERO(0);
@@ -25,8 +26,8 @@ std::ostream& operator<<(std::ostream &strm, const BigInt& bn){
  **/
 
 //The value that bits is set to should be used for both bits and for the shift in base
+//Does not allocate, so that results built into a default constructed BigInt or moved into one only allocate once
 BigInt::BigInt(): limbs(), bits(31), negative(false), base(static_cast<unsigned int>(1 << 31)) {
-    limbs.reserve(5);
 }
 
 //Assume string is in the form of [sign], digit , {digit}
@@ -35,6 +36,8 @@ BigInt::BigInt(const std::string& s): BigInt(){
         *this = BigInt(stoll(s));
         return;
     }       
+    //A limb holds a bit over 9 decimal digits
+    BIGINT_STATS_SCOPE(FROM_STRING, s.size() / 9 + 1);
 
     for(auto c : s) {
         if(c == '+') negative = false;
@@ -79,6 +82,8 @@ BigInt::BigInt(limb_t ull): BigInt() {
 
 
 void BigInt::CtorHelper(limb_t ull) {
+    //A limb_t takes at most 3 limbs
+    limbs.reserve(3);
     //Push each set of bits onto the vector
     do {
         //assign the $bits least significant bits to tmp
@@ -94,12 +99,19 @@ BigInt::BigInt(const BigInt& b): limbs(b.limbs), bits(b.bits), negative(b.negati
 BigInt::BigInt(BigInt&& rhs): limbs(std::move(rhs.limbs)), bits(std::move(rhs.bits)), negative(std::move(rhs.negative)), base(std::move(rhs.base)) {
 }
 
+//Copy with room for capacity limbs, so that a result growing into it does not reallocate
+BigInt::BigInt(const BigInt& b, size_t capacity): limbs(), bits(b.bits), negative(b.negative), base(b.base) {
+    limbs.reserve(std::max(capacity, b.size()));
+    limbs.assign(b.limbs.begin(), b.limbs.end());
+}
+
 void BigInt::swap(BigInt& rhs){
     using std::swap;
 
     swap(this->limbs,   rhs.limbs);
     swap(this->bits,    rhs.bits);
     swap(this->negative, rhs.negative);
+    swap(this->base,    rhs.base);
 }
 
 void BigInt::reallign() {
@@ -185,6 +197,7 @@ std::string BigInt::ToBinary() const {
 }
 
 std::string BigInt::ToDecimal() const {
+    BIGINT_STATS_SCOPE(TO_DECIMAL, size());
     std::string ret;
     BigInt tmp(*this);
     limb_t oneBillion = 1000000000;
@@ -224,55 +237,138 @@ BigInt& BigInt::operator=(BigInt rhs){
     swap(rhs);
     return *this;
 }
-BigInt BigInt::operator+(const BigInt& rhs) const{
-    BigInt tmp(*this);
+BigInt BigInt::operator+(const BigInt& rhs) const &{
+    BigInt tmp(*this, std::max(size(), rhs.size()) + 1);
     tmp += rhs;
     return tmp;
 }
 
+BigInt BigInt::operator+(const BigInt& rhs) &&{
+    *this += rhs;
+    return std::move(*this);
+}
+
+BigInt BigInt::operator+(BigInt&& rhs) const &{
+    rhs += *this;
+    return std::move(rhs);
+}
+
+BigInt BigInt::operator+(BigInt&& rhs) &&{
+    //Keep the buffer more likely to hold the sum without growing
+    if(rhs.limbs.capacity() > this->limbs.capacity()) {
+        rhs += *this;
+        return std::move(rhs);
+    }
+    *this += rhs;
+    return std::move(*this);
+}
+
 BigInt BigInt::operator++(int){
     BigInt tmp(*this);
     ++(*this);
     return tmp;
 }
 
-BigInt BigInt::operator-(const BigInt& rhs) const{
-    BigInt tmp(*this);
+BigInt BigInt::operator-(const BigInt& rhs) const &{
+    BigInt tmp(*this, std::max(size(), rhs.size()) + 1);
     tmp -= rhs;
     return tmp;
 }
-BigInt BigInt::operator/(const BigInt& rhs) const{
+
+BigInt BigInt::operator-(const BigInt& rhs) &&{
+    *this -= rhs;
+    return std::move(*this);
+}
+
+//a - b = -(b - a)
+BigInt BigInt::operator-(BigInt&& rhs) const &{
+    rhs -= *this;
+    if(!rhs.isZero()) {
+        rhs.negative = !rhs.negative;
+    }
+    return std::move(rhs);
+}
+
+BigInt BigInt::operator-(BigInt&& rhs) &&{
+    *this -= rhs;
+    return std::move(*this);
+}
+
+BigInt BigInt::operator/(const BigInt& rhs) const &{
     BigInt tmp(*this);
     tmp /= rhs;
     return tmp;
 }
-BigInt BigInt::operator*(const BigInt& rhs) const{
-    BigInt tmp(*this);
-    tmp *= rhs;
+
+BigInt BigInt::operator/(const BigInt& rhs) &&{
+    *this /= rhs;
+    return std::move(*this);
+}
+
+//The product is built in a new buffer either way, so *this is not copied first
+BigInt BigInt::operator*(const BigInt& rhs) const &{
+    BigInt tmp = this->size() < 20 || rhs.size() < 20 || this->size() + rhs.size() < 80 ?
+        naiveMul(*this, rhs) : karatsuba(*this, rhs);
+    tmp.negative = this->negative != rhs.negative;
     return tmp;
 }
 
-BigInt BigInt::operator*(const limb_t& rhs) const{
-    BigInt tmp(*this);
+BigInt BigInt::operator*(const BigInt& rhs) &&{
+    *this *= rhs;
+    return std::move(*this);
+}
+
+BigInt BigInt::operator*(BigInt&& rhs) const &{
+    rhs *= *this;
+    return std::move(rhs);
+}
+
+BigInt BigInt::operator*(BigInt&& rhs) &&{
+    *this *= rhs;
+    return std::move(*this);
+}
+
+BigInt BigInt::operator*(const limb_t& rhs) const &{
+    BigInt tmp(*this, size() + 1);
     tmp *= rhs;
     return tmp;
 }
 
-BigInt BigInt::operator%(const BigInt& rhs) const{
+BigInt BigInt::operator*(const limb_t& rhs) &&{
+    *this *= rhs;
+    return std::move(*this);
+}
+
+BigInt BigInt::operator%(const BigInt& rhs) const &{
     BigInt tmp(*this);
     tmp %= rhs;
     return tmp;
 }
+
+BigInt BigInt::operator%(const BigInt& rhs) &&{
+    *this %= rhs;
+    return std::move(*this);
+}
+
 BigInt& BigInt::operator+=(const BigInt& rhs){
+    if(this->negative != rhs.negative) {
+        subMagnitude(rhs);
+    } else {
+        addMagnitude(rhs);
+    }
+    return *this;
+}
 
-    //Figure out implementation details of negatives later, either as creating an
-    //extended twos compliment number from the limbs, or through manipulation of a
-    //sign bit otherwhere (such as a "negative" boolean")
+BigInt& BigInt::operator-=(const BigInt& rhs){
     if(this->negative != rhs.negative) {
-        *this -= -rhs;	
-        return *this;
+        addMagnitude(rhs);
+    } else {
+        subMagnitude(rhs);
     }
+    return *this;
+}
 
+void BigInt::addMagnitude(const BigInt& rhs){
     if(rhs.size() > this->size()) this->limbs.resize(rhs.size(), 0);
 
     //Is it faster to have the carry and add separate, or would it be better to keep them together?
@@ -299,8 +395,6 @@ BigInt& BigInt::operator+=(const BigInt& rhs){
     if(carry) {
         this->limbs.push_back(carry);
     }
-
-    return *this;
 }
 
 BigInt& BigInt::operator++() {
@@ -308,12 +402,7 @@ BigInt& BigInt::operator++() {
     return *this;
 }
 
-BigInt& BigInt::operator-=(const BigInt& rhs){
-    if(this->negative != rhs.negative) {
-        *this += -rhs;
-        return *this;
-    }
-
+void BigInt::subMagnitude(const BigInt& rhs){
     if(rhs.size() > this->size()) {
         this->limbs.resize(rhs.size(), 0);
     }
@@ -344,12 +433,21 @@ BigInt& BigInt::operator-=(const BigInt& rhs){
             return this->base -1 - a;
         };
         std::transform(this->limbs.begin(), this->limbs.end(), this->limbs.begin(), subtract);
-        this->limbs[0]++;
+        //The +1 of the twos compliment has to carry through any limbs that were base -1
+        for(auto it = this->limbs.begin(); it < this->limbs.end(); ++it) {
+            if(++(*it) < this->base) { break; }
+            *it = 0;
+        }
     }
 
-    //Needed in case this->limb[0] = 0 and we had to borrow the carry above as this would result in a limb outside of acceptable ranges
-    //this->reallign();
-    return *this;    
+    //Cancelled high limbs would otherwise make equal values compare as different sizes
+    while(this->limbs.size() > 1) {
+        if(this->limbs.back() != 0) { break; }
+        this->limbs.pop_back();
+    }
+    if(this->limbs.size() == 1 && this->limbs[0] == 0) {
+        this->negative = false;
+    }
 }
 
 BigInt& BigInt::operator*=(const BigInt& rhs){
@@ -403,11 +501,19 @@ BigInt& BigInt::operator/=(const BigInt& rhs){
 BigInt& BigInt::operator%=(const BigInt& rhs){
     if(*this < BigInt::ZERO) {
         *this = abs(*this);
-        if(*this > rhs) {
+        if(*this > rhs && !reduceSpecialForm(rhs)) {
             BigInt::div(nullptr, *this, rhs, this);
         }
-        *this = rhs - *this;
-        //this->reallign();
+        //Multiples of rhs, and -0, reduce to 0, not rhs
+        if(this->isZero()) {
+            this->negative = false;
+            return *this;
+        }
+        //rhs - *this, computed in place
+        *this -= rhs;
+        if(!this->isZero()) {
+            this->negative = !this->negative;
+        }
         return *this;
     }
 
@@ -419,21 +525,39 @@ BigInt& BigInt::operator%=(const BigInt& rhs){
         return *this;
     }
 
-    BigInt::div(nullptr, *this, rhs, this);
+    //Moduli next to a power of two fold instead of dividing
+    if(!reduceSpecialForm(rhs)) {
+        BigInt::div(nullptr, *this, rhs, this);
+    }
 
     return *this;
 }
 
-BigInt BigInt::operator-() const{
+BigInt BigInt::operator-() const &{
     BigInt tmp(*this);
     tmp.negative = !tmp.negative;
     return tmp;
 }
 
+BigInt BigInt::operator-() &&{
+    this->negative = !this->negative;
+    return std::move(*this);
+}
+
+//Number of limbs without leading zero limbs, which some operations leave behind
+static size_t usedLimbs(const BigInt& n) {
+    size_t size = n.size();
+    while(size > 1 && n.limbs[size - 1] == 0) {
+        --size;
+    }
+    return size;
+}
+
 //Who needs constant-time operators anyways?
 bool BigInt::operator==(const BigInt& rhs) const{
-    if(this->size() != rhs.size()) return false;
-    for(int i = this->size() -1; i >= 0; i--) {
+    size_t size = usedLimbs(*this);
+    if(size != usedLimbs(rhs)) return false;
+    for(int i = size -1; i >= 0; i--) {
         if (this->limbs[i] != rhs.limbs[i]) return false;	
     }
 
@@ -450,15 +574,16 @@ bool BigInt::operator>(const BigInt& rhs) const{
 
 bool BigInt::operator<(const BigInt& rhs) const{
     if(this->negative != rhs.negative) return this->negative;
+    size_t size = usedLimbs(*this), rhs_size = usedLimbs(rhs);
     if(this->negative) {
-        if(this->size() != rhs.size()) return this->size() > rhs.size();
+        if(size != rhs_size) return size > rhs_size;
 
         /*
          * Starting at "false" and checking if each limb is either over or under ensures 
          * that two equivalent limbs do not return "true"
          */
         bool result = false;
-        for(int i = 0; i < this->size(); i++) {
+        for(size_t i = 0; i < size; i++) {
             if(this->limbs[i] < rhs.limbs[i]) result = false;
             if(this->limbs[i] > rhs.limbs[i]) result = true;
         }
@@ -466,14 +591,14 @@ bool BigInt::operator<(const BigInt& rhs) const{
         return result;
 
     } else {
-        if(this->size() != rhs.size()) return this->size() < rhs.size();
+        if(size != rhs_size) return size < rhs_size;
 
         /*
          * Starting at "false" and checking if each limb is either over or under ensures 
          * that two equivalent limbs do not return "true"
          */
         bool result = false;
-        for(int i = 0; i < this->size(); i++) {
+        for(size_t i = 0; i < size; i++) {
             if(this->limbs[i] < rhs.limbs[i]) result = true;
             if(this->limbs[i] > rhs.limbs[i]) result = false;
         }
@@ -500,82 +625,294 @@ BigInt BigInt::abs(const BigInt& lhs) const {
     return tmp;
 }
 
-BigInt BigInt::gcd(const BigInt& rhs) const{
-    if(rhs == BigInt::ZERO || rhs.size() == 0) {
-        return *this;
-    } else if(*this == rhs) {
-        return *this; 
-    } else {
-        return rhs.gcd(*this % rhs);
-    }
-}
-
 limb_t BigInt::log2(const limb_t lt) {
     if(lt == 0) return 0;
-    limb_t ret = 0;
-    asm("bsrq %1, %0" : "=r" (ret) : "r" (lt));
-    return ret;
+    return 63 - __builtin_clzll(lt);
 }
 
 BigInt BigInt::log2(const BigInt& num) {
-    BigInt ret = static_cast<limb_t>((num.size() -1) * num.bits);
-    ret += log2(num.limbs[num.size() -1]);
-    return ret;
+    size_t length = num.bitLength();
+    return BigInt(static_cast<limb_t>(length == 0 ? 0 : length - 1));
+}
+
+/*
+ * Bit queries, all of them on the magnitude and tolerant of leading zero limbs
+ */
+
+//Number of significant bits, 0 for zero
+size_t BigInt::bitLength() const {
+    for(size_t i = this->size(); i-- > 0; ) {
+        if(this->limbs[i] != 0) {
+            return i * this->bits + log2(this->limbs[i]) + 1;
+        }
+    }
+    return 0;
+}
+
+//Number of zero bits below the lowest set bit, 0 for zero
+size_t BigInt::countTrailingZeros() const {
+    for(size_t i = 0; i < this->size(); ++i) {
+        if(this->limbs[i] != 0) {
+            return i * this->bits + __builtin_ctzll(this->limbs[i]);
+        }
+    }
+    return 0;
 }
 
+size_t BigInt::popcount() const {
+    size_t count = 0;
+    for(auto limb : this->limbs) {
+        count += __builtin_popcountll(limb);
+    }
+    return count;
+}
+
+bool BigInt::testBit(size_t i) const {
+    size_t limb = i / this->bits;
+    return limb < this->size() && ((this->limbs[limb] >> (i % this->bits)) & 1);
+}
+
+BigInt& BigInt::setBit(size_t i) {
+    size_t limb = i / this->bits;
+    if(limb >= this->size()) {
+        this->limbs.resize(limb + 1, 0);
+    }
+    this->limbs[limb] |= static_cast<limb_t>(1) << (i % this->bits);
+    return *this;
+}
+
+BigInt& BigInt::clearBit(size_t i) {
+    size_t limb = i / this->bits;
+    if(limb < this->size()) {
+        this->limbs[limb] &= ~(static_cast<limb_t>(1) << (i % this->bits));
+        while(this->size() > 1 && this->limbs.back() == 0) {
+            this->limbs.pop_back();
+        }
+        if(this->isZero()) {
+            this->negative = false;
+        }
+    }
+    return *this;
+}
+
+bool BigInt::isOdd() const {
+    return !this->limbs.empty() && (this->limbs[0] & 1);
+}
+
+bool BigInt::isZero() const {
+    for(size_t i = this->size(); i-- > 0; ) {
+        if(this->limbs[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//-1, 0 or 1
+int BigInt::sign() const {
+    if(this->isZero()) {
+        return 0;
+    }
+    return this->negative ? -1 : 1;
+}
+
+/*
+ * Shifts work on the magnitude and keep the sign, so (-x) >> i == -(x >> i). Both directions move the
+ * limbs and bits in a single in-place pass, each output limb being the funnel of two neighbouring input
+ * limbs, and only allocate if a left shift outgrows the capacity of the vector.
+ */
 BigInt& BigInt::lshift(int i){
-    if(i == 0) {
+    if(i < 0) {
+        return rshift(-i);
+    }
+    if(i == 0 || (this->size() == 1 && this->limbs[0] == 0)) {
         return *this;
-    } else if((i % bits) == 0) {
-        return lLimbShift(i/bits);
-    } else {
-        //insert i/bits empty limbs at the beginning then shift every limb left by i%bits
+    }
 
+    size_t limb_shift = i / bits;
+    int bit_shift = i % bits;
+    if(bit_shift == 0) {
+        return lLimbShift(limb_shift);
+    }
 
-        return *this;
+    //Funnel from the top down so every input limb is read before it is overwritten
+    size_t n = this->size();
+    limb_t mask = base - 1;
+    this->limbs.resize(n + limb_shift + 1);
+    this->limbs[n + limb_shift] = this->limbs[n - 1] >> (bits - bit_shift);
+    for(size_t k = n - 1; k > 0; --k) {
+        this->limbs[k + limb_shift] = ((this->limbs[k] << bit_shift) & mask) | (this->limbs[k - 1] >> (bits - bit_shift));
+    }
+    this->limbs[limb_shift] = (this->limbs[0] << bit_shift) & mask;
+    std::fill(this->limbs.begin(), this->limbs.begin() + limb_shift, 0);
+
+    while(this->size() > 1 && this->limbs.back() == 0) {
+        this->limbs.pop_back();
     }
+    return *this;
 }
+
 BigInt& BigInt::lLimbShift(int i){
-    if(i == 0) return *this;
+    if(i <= 0) return *this;
 
-    this->limbs.insert(this->limbs.begin(), i, 0);
+    size_t n = this->size();
+    this->limbs.resize(n + i);
+    std::move_backward(this->limbs.begin(), this->limbs.begin() + n, this->limbs.end());
+    std::fill(this->limbs.begin(), this->limbs.begin() + i, 0);
     return *this;
 }
 
 BigInt& BigInt::rshift(int i) {
+    if(i < 0) {
+        return lshift(-i);
+    }
     if(i == 0) {
         return *this;
     }
 
-    auto limb_shift = i / this->bits;
-    this->rLimbShift(limb_shift);
-    auto bit_shift = i % this->bits;
-
-    if(bit_shift == 0) {
-        return *this;
+    size_t limb_shift = i / this->bits;
+    int bit_shift = i % this->bits;
+    if(bit_shift == 0 || limb_shift >= this->size()) {
+        return rLimbShift(limb_shift);
     }
-    auto mask = (1 << i) - 1;
-    auto shift = 0;
-    for(auto x = this->limbs.end() -1; x >= this->limbs.begin(); --x) {
-        auto tmp = *x & mask;
-        *x >>= bit_shift;
-        *x |= shift;
-        shift = tmp << (this->bits - bit_shift); 
+
+    //Funnel from the bottom up, the mask must only cover the bits that move to the next lower limb
+    size_t n = this->size() - limb_shift;
+    limb_t mask = base - 1;
+    for(size_t k = 0; k + 1 < n; ++k) {
+        this->limbs[k] = (this->limbs[k + limb_shift] >> bit_shift) | ((this->limbs[k + limb_shift + 1] << (bits - bit_shift)) & mask);
     }
+    this->limbs[n - 1] = this->limbs[n - 1 + limb_shift] >> bit_shift;
+    this->limbs.resize(n);
 
+    while(this->size() > 1 && this->limbs.back() == 0) {
+        this->limbs.pop_back();
+    }
+    if(this->size() == 1 && this->limbs[0] == 0) {
+        this->negative = false;
+    }
     return *this;   
 }
 
 
 BigInt& BigInt:: rLimbShift(int i) {
-    if(i == 0) return *this;
+    if(i <= 0) return *this;
     if(i >= this->size()) {
-        *this = BigInt::ZERO;
+        this->limbs.assign(1, 0);
+        this->negative = false;
         return *this;
     }
-    std::vector<limb_t> vt;
-    vt.insert(vt.begin(), this->limbs.begin() + i, this->limbs.end());
-    this->limbs = std::move(vt);
+    std::move(this->limbs.begin() + i, this->limbs.end(), this->limbs.begin());
+    this->limbs.resize(this->size() - i);
+    return *this;
+}
+
+BigInt BigInt::operator<<(int i) const {
+    BigInt tmp(*this);
+    tmp.lshift(i);
+    return tmp;
+}
+
+BigInt BigInt::operator>>(int i) const {
+    BigInt tmp(*this);
+    tmp.rshift(i);
+    return tmp;
+}
+
+BigInt& BigInt::operator<<=(int i) {
+    return lshift(i);
+}
+
+BigInt& BigInt::operator>>=(int i) {
+    return rshift(i);
+}
+
+//Limb k of |n| << (limb_shift * bits + bit_shift), without forming the shifted number
+static limb_t shiftedLimb(const BigInt& n, size_t k, size_t limb_shift, int bit_shift, limb_t mask) {
+    if(k < limb_shift) {
+        return 0;
+    }
+    size_t j = k - limb_shift;
+    limb_t r = j < n.size() ? (n.limbs[j] << bit_shift) & mask : 0;
+    if(bit_shift != 0 && j > 0 && j - 1 < n.size()) {
+        r |= n.limbs[j - 1] >> (n.bits - bit_shift);
+    }
+    return r;
+}
+
+//*this += rhs << shift
+BigInt& BigInt::addShifted(const BigInt& rhs, int shift) {
+    if(this->negative != rhs.negative) {
+        return subShifted(-rhs, shift);
+    }
+
+    size_t limb_shift = shift / bits;
+    int bit_shift = shift % bits;
+    size_t len = rhs.size() + limb_shift + 1;
+    if(this->size() < len) {
+        this->limbs.resize(len, 0);
+    }
+
+    limb_t mask = base - 1;
+    limb_t carry = 0;
+    for(size_t k = limb_shift; k < this->size(); ++k) {
+        if(k >= len && carry == 0) {
+            break;
+        }
+        limb_t sum = this->limbs[k] + shiftedLimb(rhs, k, limb_shift, bit_shift, mask) + carry;
+        this->limbs[k] = sum & mask;
+        carry = sum >> bits;
+    }
+    if(carry) {
+        this->limbs.push_back(carry);
+    }
+
+    while(this->size() > 1 && this->limbs.back() == 0) {
+        this->limbs.pop_back();
+    }
+    return *this;
+}
+
+//*this -= rhs << shift
+BigInt& BigInt::subShifted(const BigInt& rhs, int shift) {
+    if(this->negative != rhs.negative) {
+        return addShifted(-rhs, shift);
+    }
+
+    size_t limb_shift = shift / bits;
+    int bit_shift = shift % bits;
+    size_t len = rhs.size() + limb_shift + 1;
+    if(this->size() < len) {
+        this->limbs.resize(len, 0);
+    }
+
+    limb_t mask = base - 1;
+    long long borrow = 0;
+    for(size_t k = limb_shift; k < this->size(); ++k) {
+        if(k >= len && borrow == 0) {
+            break;
+        }
+        long long diff = static_cast<long long>(this->limbs[k]) - static_cast<long long>(shiftedLimb(rhs, k, limb_shift, bit_shift, mask)) + borrow;
+        this->limbs[k] = diff & mask;
+        borrow = diff >> bits;
+    }
+    //The shifted value was larger, the limbs hold 2^(size * bits) - |result|
+    if(borrow) {
+        long long carry = 1;
+        for(auto& limb : this->limbs) {
+            long long t = static_cast<long long>(mask - limb) + carry;
+            limb = t & mask;
+            carry = t >> bits;
+        }
+        this->negative = !this->negative;
+    }
+
+    while(this->size() > 1 && this->limbs.back() == 0) {
+        this->limbs.pop_back();
+    }
+    if(this->size() == 1 && this->limbs[0] == 0) {
+        this->negative = false;
+    }
     return *this;
 }
 
@@ -610,21 +947,175 @@ BigInt BigInt::pow(BigInt exp) const {
  * MULTIPLICATION HELPER METHODS
  */
 
+//dst[0, n) += a[0, n) * b for b < base, returning the carry out of dst[n - 1]
+limb_t BigInt::addmul_1(limb_t * dst, const limb_t * a, size_t n, limb_t b) {
+    const limb_t mask = (static_cast<limb_t>(1) << 31) - 1;
+    limb_t carry = 0;
+    for(size_t i = 0; i < n; ++i) {
+        limb_t t = dst[i] + a[i] * b + carry;
+        dst[i] = t & mask;
+        carry = t >> 31;
+    }
+    return carry;
+}
+
+//dst[0, n) -= a[0, n) * b for b < base, returning the borrow out of dst[n - 1]
+limb_t BigInt::submul_1(limb_t * dst, const limb_t * a, size_t n, limb_t b) {
+    const limb_t mask = (static_cast<limb_t>(1) << 31) - 1;
+    limb_t borrow = 0;
+    for(size_t i = 0; i < n; ++i) {
+        limb_t p = a[i] * b + borrow;
+        limb_t t = dst[i] - (p & mask);
+        dst[i] = t & mask;
+        //The low half of p was larger when t wrapped around
+        borrow = (p >> 31) + (t >> 63);
+    }
+    return borrow;
+}
+
+BigInt& BigInt::addmul(const BigInt& a, const BigInt& b) {
+    mulAccumulate(a, b, a.negative != b.negative);
+    return *this;
+}
+
+BigInt& BigInt::submul(const BigInt& a, const BigInt& b) {
+    mulAccumulate(a, b, a.negative == b.negative);
+    return *this;
+}
+
+BigInt& BigInt::addmul_1(const BigInt& a, limb_t b) {
+    if(b >= base) {
+        return addmul(a, BigInt(b));
+    }
+    BigInt limb;
+    limb.limbs.push_back(b);
+    mulAccumulate(a, limb, a.negative);
+    return *this;
+}
+
+BigInt& BigInt::submul_1(const BigInt& a, limb_t b) {
+    if(b >= base) {
+        return submul(a, BigInt(b));
+    }
+    BigInt limb;
+    limb.limbs.push_back(b);
+    mulAccumulate(a, limb, !a.negative);
+    return *this;
+}
+
+/*
+ * *this += |a| * |b| with the product taking the sign product_negative. In the schoolbook range the
+ * product is never formed: each limb of the shorter operand adds or subtracts one row straight into
+ * *this, and if subtracting takes *this below zero the limbs end up holding the complement, which is
+ * negated at the end as in subMagnitude.
+ */
+void BigInt::mulAccumulate(const BigInt& a, const BigInt& b, bool product_negative) {
+    size_t na = usedLimbs(a), nb = usedLimbs(b);
+    if(a.isZero() || b.isZero()) {
+        return;
+    }
+    if(&a == this || &b == this || !(na < 20 || nb < 20 || na + nb < 80)) {
+        BigInt product = a * b;
+        product.negative = product_negative;
+        *this += product;
+        return;
+    }
+    const BigInt& row = na >= nb ? a : b;
+    const BigInt& col = na >= nb ? b : a;
+    size_t n_row = std::max(na, nb), n_col = std::min(na, nb);
+
+    if(this->isZero()) {
+        this->negative = product_negative;
+    }
+    size_t len = std::max(usedLimbs(*this), na + nb) + 1;
+    this->limbs.resize(len, 0);
+    const limb_t mask = base - 1;
+
+    if(this->negative == product_negative) {
+        for(size_t j = 0; j < n_col; ++j) {
+            limb_t carry = addmul_1(&this->limbs[j], row.limbs.data(), n_row, col.limbs[j]);
+            for(size_t k = j + n_row; carry; ++k) {
+                limb_t t = this->limbs[k] + carry;
+                this->limbs[k] = t & mask;
+                carry = t >> bits;
+            }
+        }
+    } else {
+        bool wrapped = false;
+        for(size_t j = 0; j < n_col; ++j) {
+            limb_t borrow = submul_1(&this->limbs[j], row.limbs.data(), n_row, col.limbs[j]);
+            for(size_t k = j + n_row; borrow; ++k) {
+                if(k == len) {
+                    wrapped = true;
+                    break;
+                }
+                //The row's borrow can be a little over base, so this can borrow 2
+                long long t = static_cast<long long>(this->limbs[k]) - static_cast<long long>(borrow);
+                this->limbs[k] = t & mask;
+                borrow = -(t >> bits);
+            }
+        }
+        if(wrapped) {
+            limb_t carry = 1;
+            for(auto& limb : this->limbs) {
+                limb_t t = (mask - limb) + carry;
+                limb = t & mask;
+                carry = t >> bits;
+            }
+            this->negative = !this->negative;
+        }
+    }
+
+    while(this->size() > 1 && this->limbs.back() == 0) {
+        this->limbs.pop_back();
+    }
+    if(this->size() == 1 && this->limbs[0] == 0) {
+        this->negative = false;
+    }
+}
+
 /**
  * Karatsuba multiplication is taking two integers x = x_1*B^m + x_0, y = y_1*B^m +y_0
  * where B is the radix of the system, in this case it is 2^(bits) -1. Therefore xy
  * is of the form z_2*B^(2m) + z_1*B^m + z_0 
  */
 //Currently horribly inefficient and it is more optimal to just use naiveMul even at 140 limbs
-BigInt BigInt::karatsuba(const BigInt& n1, const BigInt& n2) {
+BigInt BigInt::karatsuba(const BigInt& n1, const BigInt& n2) const {
     if(n1.size() < 20 || n2.size() < 20 || n1.size() + n2.size() < 80) {
         return naiveMul(n1, n2);
     }
+    BIGINT_STATS_SCOPE(MUL_KARATSUBA, n1.size() + n2.size());
 
 
     std::vector<limb_t> scratch(n1.size() + n2.size(), 0);
 
-    karatsuba(n1.limbs, n2.limbs, scratch, 0, 0, n1.size(), 0, n2.size());     
+    if(n1.size() >= 2 * n2.size() || n2.size() >= 2 * n1.size()) {
+        //The split point is based on the smaller operand, which degenerates for unbalanced operands,
+        //so multiply the larger one in slices the size of the smaller one and add up the partial products
+        const BigInt& big = n1.size() > n2.size() ? n1 : n2;
+        const BigInt& small = n1.size() > n2.size() ? n2 : n1;
+        std::vector<limb_t> part(2 * small.size(), 0);
+
+        for(unsigned offset = 0; offset < big.size(); offset += small.size()) {
+            unsigned len = std::min(small.size(), big.size() - offset);
+            std::fill(part.begin(), part.end(), 0);
+            karatsuba(big.limbs, small.limbs, part, 0, offset, len, 0, small.size());
+
+            limb_t carry = 0;
+            for(unsigned i = 0; i < len + small.size(); ++i) {
+                limb_t t = scratch[offset + i] + part[i] + carry;
+                carry = t >> bits;
+                scratch[offset + i] = t & (base -1);
+            }
+            for(unsigned i = offset + len + small.size(); carry && i < scratch.size(); ++i) {
+                limb_t t = scratch[i] + carry;
+                carry = t >> bits;
+                scratch[i] = t & (base -1);
+            }
+        }
+    } else {
+        karatsuba(n1.limbs, n2.limbs, scratch, 0, 0, n1.size(), 0, n2.size());     
+    }
 
     while(scratch.size() > 1){
         if(scratch.back() != 0) { break; }
@@ -640,7 +1131,7 @@ BigInt BigInt::karatsuba(const BigInt& n1, const BigInt& n2) {
 
 void BigInt::karatsuba(const std::vector<limb_t>& n1, const std::vector<limb_t>& n2, std::vector<limb_t>& scratch, 
         unsigned scratch_offset, unsigned n1l_offset, unsigned n1_size, 
-        unsigned n2l_offset, unsigned n2_size ) {
+        unsigned n2l_offset, unsigned n2_size ) const {
     if(n1_size < 20 || n2_size < 20 || n1_size + n2_size < 80) {
         naiveMul(n1.begin() + n1l_offset, n2.begin() + n2l_offset, scratch.begin() + scratch_offset, n1_size, n2_size);
         return;
@@ -675,34 +1166,22 @@ void BigInt::karatsuba(const std::vector<limb_t>& n1, const std::vector<limb_t>&
 
     std::transform(n1.begin() + n1l_offset + m, n1.begin() + n1l_offset + n1_size, 
             n1l.begin(), n1l.begin(), add_with_carry);
-    if(carry) {
-        if(n1_size - m == n1l.size()) {
-            n1l.push_back(carry);
-        } else {
-            n1l[n1_size -m] += carry;
-            if(n1l[n1_size -m] >= this->base) {
-                carry = n1l[n1_size -m] >> bits;
-                n1l[n1_size -m] &= this->base -1;
-                n1l.push_back(carry);
-            }
+    for(unsigned i = n1_size - m; carry; ++i) {
+        if(i == n1l.size()) {
+            n1l.push_back(0);
         }
+        n1l[i] = add_with_carry(n1l[i], 0);
     }
 
     carry = 0;
 
     std::transform(n2.begin() + n2l_offset + m, n2.begin() + n2l_offset + n2_size, 
             n2l.begin(), n2l.begin(), add_with_carry);
-    if(carry) {
-        if(n2_size - m == n2l.size()) {
-            n2l.push_back(carry);
-        } else {
-            n2l[n2_size -m] += carry;
-            if(n2l[n2_size -m] >= this->base) {
-                carry = n2l[n2_size -m] >> bits;
-                n2l[n2_size -m] &= this->base -1;
-                n2l.push_back(carry);
-            }
+    for(unsigned i = n2_size - m; carry; ++i) {
+        if(i == n2l.size()) {
+            n2l.push_back(0);
         }
+        n2l[i] = add_with_carry(n2l[i], 0);
     }
 
     std::vector<limb_t> z1(n1l.size() + n2l.size(), 0);
@@ -718,283 +1197,57 @@ void BigInt::karatsuba(const std::vector<limb_t>& n1, const std::vector<limb_t>&
         return c;
     };
 
-    //z1 -= z2
+    //z1 -= z2, z1 is the larger so the borrow stops inside it
     std::transform(scratch.begin() + scratch_offset, scratch.begin() + scratch_offset + 2*m, 
             z1.begin(), z1.begin(), sub_with_carry);
+    for(unsigned i = 2*m; carry; ++i) {
+        z1[i] = sub_with_carry(0, z1[i]);
+    }
 
-    z1[2*m - 1 + carry] -= carry;
-
-    carry = 0;
     //z1 -= z0
     std::transform(scratch.begin() + scratch_offset + 2*m, scratch.begin() + scratch_offset + n1_size + n2_size, 
             z1.begin(), z1.begin(), sub_with_carry);
+    for(unsigned i = n1_size + n2_size - 2*m; carry; ++i) {
+        z1[i] = sub_with_carry(0, z1[i]);
+    }
 
-    z1[n1_size + n2_size - 2*m - 1 + carry] -= carry;
-
-    carry = 0;
-
-    //z0 * base^{2m} + z1 * base^m + z2
-    std::transform(z1.begin(), z1.end(), scratch.begin() + scratch_offset + m,
+    //z0 * base^{2m} + z1 * base^m + z2, the product fits in n1_size + n2_size limbs so the top limbs of z1
+    //past that are zero and the carry stops before the end
+    const unsigned end = scratch_offset + n1_size + n2_size;
+    const unsigned len = std::min<unsigned>(z1.size(), end - scratch_offset - m);
+    std::transform(z1.begin(), z1.begin() + len, scratch.begin() + scratch_offset + m,
             scratch.begin() + scratch_offset + m, add_with_carry);
-    if(carry) {
-        scratch[scratch_offset + m + z1.size()] += carry;
-        if(scratch[scratch_offset + m + z1.size()] >= this->base) {
-            std::cout << "overflow with carrying the carry" << std::endl;
-        }
+    for(unsigned i = scratch_offset + m + len; carry && i < end; ++i) {
+        scratch[i] = add_with_carry(scratch[i], 0);
     }
 
 }
 
 void BigInt::naiveMul(std::vector<limb_t>::const_iterator n1, std::vector<limb_t>::const_iterator n2, 
-        std::vector<limb_t>::iterator scratch, unsigned n1_size, unsigned n2_size ){
+        std::vector<limb_t>::iterator scratch, unsigned n1_size, unsigned n2_size ) const {
+    BIGINT_STATS_SCOPE(MUL_BASECASE, n1_size + n2_size);
 
     if(n1_size == n2_size && std::equal(n1, n1 + n1_size, n2)) {
-        //HAC algorithm 14.16 for squaring
-        //http://cacr.uwaterloo.ca/hac/about/chap14.pdf
-        limb_t uv, c; //,u=0, v=0;
-        for(int i = 0; i < n1_size; ++i) {
-            uv = *(scratch + i + i) + *(n1 + i) * *(n1 +i);
-            //u = uv >> bits;
-            //v = uv & (base -1);
-            c = uv >> bits;
-            *(scratch + i + i) = uv & (base-1);
-            for(int j = i+1; j< n1_size; ++j) {
-                uv = *(scratch + i + j) + 2* *(n1 + i)* *(n1 + j) + c;
-                //u = uv >> bits;
-                //v = uv & (base -1);
-                *(scratch + i + j) = uv & (base -1);
-                c = uv >> bits;
-            }
-
-            *(scratch + i + n1_size) = c;
-        }
-
-        if(*(scratch + n1_size + n1_size -1) >= base) {
-            c = *(scratch + n1_size + n1_size -1) >> bits;
-            *(scratch + n1_size + n1_size -1) &= (base -1);
-            *(scratch + n1_size + n2_size) = c;
-        }
-
-        return;
-    }
-
-
-
-
-    for(int j = 0; j < n2_size; ++j) {
-        *(scratch + j) = (*n1) * *(n2 + j);
-    }
-
-    *(scratch + 1) += *scratch >> bits;
-    *scratch &= (base -1);
-
-    /**
-     * As each limb is only 31 bits long we can add up to 4 multiplications and a carry without a 64bit int overflowing
-     * Unrolling loops, because I might as well find out if it is productive
-     * Taken from running valgrind --tool=callgrind --cache-sim=yes --branch-sim=yes ./Test using test4kModExp()
-     *		ir	 dr	    dw	     bc		bcm
-     *normal	578m	110m	    60m	    34m		.9m
-     *unrolled	404m	128.5m	    75.8m   36.9m	2.2m
-     * Clearly the compiler is magic, but it seems that the unrolled version is more efficient and running the multiplication
-     * in testMulRandom1024Bit() 100,000 times gives 
-     * normal   Avg time: 4.86*10^-6
-     * unrolled Avg time: 3.95*10^-6
-     */
-
-    int i = 1;
-    for(; i + 4 < n1_size; ++i) {
-        for(int j = 0; j < n2_size; j++) {
-            *(scratch + i+j) += *(n1 +i) * *(n2 + j);
-        }
-        *(scratch + i + 1) += *(scratch + i) >> bits;
-        *(scratch + i) &= (base -1);
-        ++i;
-
-        for(int j = 0; j < n2_size; j++) {
-            *(scratch + i + j) += *(n1 + i) * *(n2 + j);
-        }
-        *(scratch +i + 1) += *(scratch +i) >> bits;
-        *(scratch +i) &= (base -1);
-        ++i;
-
-        for(int j = 0; j < n2_size; j++) {
-            *(scratch + i + j) += *(n1 + i) * *(n2 +j);
-        }
-        *(scratch + i + 1) += *(scratch + i) >> bits;
-        *(scratch +i) &= (base -1);
-
-        //carry after every 4 mult-adds
-        for(auto it = scratch + i + 1; it < scratch + i + n2_size; ++it) {
-            *(it + 1) += *it >> bits;
-            *it &= (base - 1);		    	    
-        }	
-        ++i;
-
-        for(int j = 0; j < n2_size; j++) {
-            *(scratch+i+j) += *(n1 +i) * *(n2 + j);
-        }
-        *(scratch + i + 1) += *(scratch + i) >> bits;
-        *(scratch +i) &= (base -1);
-    }
-
-    for(; i < n1_size; ++i) {
-        for(int j = 0; j < n2_size; j++) {
-            *(scratch + i + j) += *(n1 + i) * *(n2 + j);
-        }
-        *(scratch + i + 1) += *(scratch + i) >> bits;
-        *(scratch +i) &= (base -1);
-        if(i % 4 == 3) {
-            for(auto it = scratch + i + 1; it < scratch + i + n2_size; ++it) {
-                *(it + 1) += *it >> bits;
-                *it &= (base - 1);		    	    
-            }
-        }
+        sqrBasecase(&*scratch, &*n1, n1_size);
+    } else {
+        mulBasecase(&*scratch, &*n1, n1_size, &*n2, n2_size);
     }
-
-
-
-    for(auto it = scratch + n1_size; it < scratch + n1_size + n2_size -1; ++it) {
-        *(it +1) += *it >> bits;
-        *it &= (base -1);
-    } 
-
 }
 
-//Performs a carry when a limb is no longer going to get written to, or after every 4 rows are used
-BigInt BigInt::naiveMul(const BigInt& n1, const BigInt& n2) {
+//The kernels in BigIntKernels.cpp carry when a limb is no longer going to get written to, and every few rows
+BigInt BigInt::naiveMul(const BigInt& n1, const BigInt& n2) const {
+    BIGINT_STATS_SCOPE(MUL_SCHOOLBOOK, n1.size() + n2.size());
     if(n1 == BigInt::ZERO || n2 == BigInt::ZERO) {
         return BigInt::ZERO;
     }
 
     BigInt tmp;
-    int m = n1.size() + n2.size();
-    tmp.limbs.resize(m, 0);
-
-
+    tmp.limbs.resize(n1.size() + n2.size(), 0);
     if(n1 == n2) {
-        //HAC algorithm 14.16 for squaring
-        //http://cacr.uwaterloo.ca/hac/about/chap14.pdf
-        limb_t uv, c; //,u=0, v=0;
-        for(int i = 0; i < n1.size(); ++i) {
-            uv = tmp.limbs[i+i] + n1.limbs[i] * n1.limbs[i];
-            //u = uv >> bits;
-            //v = uv & (base -1);
-            c = uv >> bits;
-            tmp.limbs[i+i] = uv & (base-1);
-            for(int j = i+1; j< n1.size(); ++j) {
-                uv = tmp.limbs[i+j] + 2*n1.limbs[i]*n1.limbs[j] + c;
-                //u = uv >> bits;
-                //v = uv & (base -1);
-                tmp.limbs[i+j] = uv & (base -1);
-                c = uv >> bits;
-            }
-
-            tmp.limbs[i + n1.size()] = c;
-        }
-        while(tmp.size() > 1){
-            if(tmp.limbs.back() != 0) { break; }
-            tmp.limbs.pop_back();
-        }
-
-        if(tmp.limbs.back() >= base) {
-            std::cout << "squared push_back needed" << std::endl;
-            c = tmp.limbs.back() >> bits;
-            tmp.limbs.back() &= (base -1);
-            tmp.limbs.push_back(c);
-        }
-
-        return tmp;
+        sqrBasecase(tmp.limbs.data(), n1.limbs.data(), n1.size());
     } else {
-        for(int j = 0; j < n2.size(); ++j) {
-            tmp.limbs[j] = n1.limbs[0] * n2.limbs[j];
-        }
-
-        tmp.limbs[1] += tmp.limbs[0] >> bits;
-        tmp.limbs[0] &= (base -1);
-
-        /**
-         * As each limb is only 31 bits long we can add up to 4 multiplications and a carry without a 64bit int overflowing
-         * Unrolling loops, because I might as well find out if it is productive
-         * Taken from running valgrind --tool=callgrind --cache-sim=yes --branch-sim=yes ./Test using test4kModExp()
-         *		ir	 dr	    dw	     bc		bcm
-         *normal	578m	110m	    60m	    34m		.9m
-         *unrolled	404m	128.5m	    75.8m   36.9m	2.2m
-         * Clearly the compiler is magic, but it seems that the unrolled version is more efficient and running the multiplication
-         * in testMulRandom1024Bit() 100,000 times gives 
-         * normal   Avg time: 4.86*10^-6
-         * unrolled Avg time: 3.95*10^-6
-         */
-        /*
-           for(int i = 1; i < n1.size(); i++) {
-           for(int j = 0; j < n2.size(); j++) {
-           tmp.limbs[i+j] += n1.limbs[i] * n2.limbs[j];
-           }
-           tmp.limbs[i + 1] += tmp.limbs[i] >> bits;
-           tmp.limbs[i] &= (base -1);
-           if(i % 4 == 3) {
-           for(auto it = tmp.limbs.begin() + i + 1; it < tmp.limbs.begin() + i + n2.size(); ++it) {
-         *(it + 1) += *it >> bits;
-         *it &= (base - 1);		    	    
-         }	
-
-         }    
-         } 
-         */
-        int i = 1;
-        for(; i + 4 < n1.size(); ++i) {
-            for(int j = 0; j < n2.size(); j++) {
-                tmp.limbs[i+j] += n1.limbs[i] * n2.limbs[j];
-            }
-            tmp.limbs[i + 1] += tmp.limbs[i] >> bits;
-            tmp.limbs[i] &= (base -1);
-            ++i;
-
-            for(int j = 0; j < n2.size(); j++) {
-                tmp.limbs[i+j] += n1.limbs[i] * n2.limbs[j];
-            }
-            tmp.limbs[i + 1] += tmp.limbs[i] >> bits;
-            tmp.limbs[i] &= (base -1);
-            ++i;
-
-            for(int j = 0; j < n2.size(); j++) {
-                tmp.limbs[i+j] += n1.limbs[i] * n2.limbs[j];
-            }
-            tmp.limbs[i + 1] += tmp.limbs[i] >> bits;
-            tmp.limbs[i] &= (base -1);
-
-            //carry after every 4 mult-adds
-            for(auto it = tmp.limbs.begin() + i + 1; it < tmp.limbs.begin() + i + n2.size(); ++it) {
-                *(it + 1) += *it >> bits;
-                *it &= (base - 1);		    	    
-            }	
-            ++i;
-
-            for(int j = 0; j < n2.size(); j++) {
-                tmp.limbs[i+j] += n1.limbs[i] * n2.limbs[j];
-            }
-            tmp.limbs[i + 1] += tmp.limbs[i] >> bits;
-            tmp.limbs[i] &= (base -1);
-        }
-
-        for(; i < n1.size(); ++i) {
-            for(int j = 0; j < n2.size(); j++) {
-                tmp.limbs[i+j] += n1.limbs[i] * n2.limbs[j];
-            }
-            tmp.limbs[i + 1] += tmp.limbs[i] >> bits;
-            tmp.limbs[i] &= (base -1);
-            if(i % 4 == 3) {
-                for(auto it = tmp.limbs.begin() + i + 1; it < tmp.limbs.begin() + i + n2.size(); ++it) {
-                    *(it + 1) += *it >> bits;
-                    *it &= (base - 1);		    	    
-                }
-            }
-        }
-    }       
-
-    for(auto it = tmp.limbs.end() - n2.size(); it < tmp.limbs.end() -1; ++it) {
-        *(it +1) += *it >> bits;
-        *it &= (base -1);
-    }      
+        mulBasecase(tmp.limbs.data(), n1.limbs.data(), n1.size(), n2.limbs.data(), n2.size());
+    }
 
     while(tmp.size() > 1){
         if(tmp.limbs.back() != 0) { break; }
@@ -1007,42 +1260,34 @@ BigInt BigInt::naiveMul(const BigInt& n1, const BigInt& n2) {
  * LIMB MANIPULATION
  */
 
+//The limb helpers return views into *this rather than copies
+
 //Returns only the high limb (limbs[size() -1) in the BigInt
-BigInt BigInt::highLimb() const{
-    BigInt tmp;
-    tmp.limbs.push_back(this->limbs.back());
-    return tmp;
+LimbRange BigInt::highLimb() const{
+    return getLimbsRange(size() - 1, size());
 }
 
-BigInt BigInt::highNLimbs(int n) const {
-    if(n > this->size()) return *this;
+LimbRange BigInt::highNLimbs(int n) const {
+    if(n > this->size()) return getLimbsRange(0, size());
 
-    BigInt tmp;
-    tmp.limbs.insert(tmp.limbs.begin(), this->limbs.end() - n, this->limbs.end());
-    return tmp;
+    return getLimbsRange(size() - n, size());
 }
 
 //Return all but the high limb (limbs[size() -1]) in the BigInt
-BigInt BigInt::lowerLimbs() const{
-    BigInt tmp(*this);
-    tmp.limbs.pop_back();
-    if(tmp.size() == 0) { tmp = BigInt::ZERO; }   
-    return tmp;
+LimbRange BigInt::lowerLimbs() const{
+    return getLimbsRange(0, size() - 1);
 }
 
-BigInt BigInt::lowerNLimbs(int n) const {
-    if(n > this->size()) return *this;
+LimbRange BigInt::lowerNLimbs(int n) const {
+    if(n > this->size()) return getLimbsRange(0, size());
 
-    BigInt tmp;
-    tmp.limbs.insert(tmp.limbs.begin(), this->limbs.begin(), this->limbs.begin() + n);
-    return tmp;
+    return getLimbsRange(0, n);
 }
 
 //Trust that the user supplied good data, gets the [start, end) limbs from *this
-BigInt BigInt::getLimbsRange(int start, int end) const {
-    BigInt tmp;
-    tmp.limbs.insert(tmp.limbs.begin(), this->limbs.begin() + start, this->limbs.begin() + end);
-    return tmp;
+LimbRange BigInt::getLimbsRange(int start, int end) const {
+    LimbRange range = {limbs.data() + start, limbs.data() + end};
+    return range;
 }
 
 /**
@@ -1050,6 +1295,7 @@ BigInt BigInt::getLimbsRange(int start, int end) const {
  */
 
 void BigInt::div(BigInt * dv, const BigInt& num, const limb_t& denom, BigInt * rem) const {
+    BIGINT_STATS_SCOPE(DIV_WORD, num.size());
     if(num.size() == 1 && num.limbs[0] == denom) {
         if(rem != nullptr) {
             //*rem = 0;
@@ -1137,6 +1383,17 @@ void BigInt::div(BigInt * dv, const BigInt& num, const limb_t& denom, BigInt * r
 //This function assumes that basic checks have already occurred: if num / denom, num = denom, etc
 void BigInt::div(BigInt * dv, const BigInt& num, const BigInt& denom, BigInt * rem) const {
 
+    //Normalization works off the leading limb, which has to be non-zero
+    if(denom.size() > 1 && denom.limbs.back() == 0) {
+        BigInt trimmed(denom);
+        while(trimmed.size() > 1 && trimmed.limbs.back() == 0) {
+            trimmed.limbs.pop_back();
+        }
+        div(dv, num, trimmed, rem);
+        return;
+    }
+    BIGINT_STATS_SCOPE(DIV_KNUTH, num.size() + denom.size());
+
     if(denom.size() == 1) {
         BigInt::div(dv, num, denom.limbs[0], rem);
         return;
@@ -1154,6 +1411,10 @@ void BigInt::div(BigInt * dv, const BigInt& num, const BigInt& denom, BigInt * r
     } else {
         a *= d;
         tmp *= d;
+        //Algorithm D needs a leading digit on the numerator, otherwise the first qhat can exceed base - 1
+        if(a.size() == num.size()) {
+            a.limbs.push_back(0);
+        }
     }
     if(a.size() == tmp.size()) {
         a.limbs.push_back(0);
@@ -1187,21 +1448,8 @@ void BigInt::div(BigInt * dv, const BigInt& num, const BigInt& denom, BigInt * r
 
         size_t first = -1 -j -tmp.size();
 
-        //mult and sub. inlined to avoid making a copy of the limbs
         //Equivalent to uprime -= tmp * qhat;
-        limb_t carry = 0;
-        std::transform(tmp.limbs.begin(), tmp.limbs.end(), a.limbs.end() + first, a.limbs.end() + first, 
-                //This lambda calculates with carries for subtraction and multiplication b -= a * qhat
-                [&](limb_t a, limb_t b) {
-                limb_t k  = a * qhat;
-                k += carry;
-                carry = k >> bits;
-                k &= (base -1);
-                int i = k > b;
-                k -= this->base * i;
-                carry += i;
-                return b - k;
-                });
+        limb_t carry = submul_1(&a.limbs[a.size() + first], tmp.limbs.data(), tmp.size(), qhat);
         a.limbs[a.size() - 1 -j] -= carry;
 
         /*
@@ -1245,6 +1493,10 @@ void BigInt::div(BigInt * dv, const BigInt& num, const BigInt& denom, BigInt * r
     } while (j <= m);
 
     if(dv != nullptr) {
+        while(acc.size() > 1) {
+            if(acc.limbs.back() != 0) { break; }
+            acc.limbs.pop_back();
+        }
         *dv = acc;
     }
 
@@ -1264,50 +1516,8 @@ void BigInt::div(BigInt * dv, const BigInt& num, const BigInt& denom, BigInt * r
 }
 
 
-BigInt BigInt::genRandomBits(const BigInt& bits){
-    //Static to seed and initialize only once
-    static std::default_random_engine generator(std::chrono::system_clock::now().time_since_epoch().count());
-    std::uniform_int_distribution<limb_t> distribution(0,bits.base-1);
-
-    BigInt result;    
-
-    auto i = BigInt::ZERO;
-    for(; i < bits - bits.bits; i += bits.bits) {
-        result.limbs.push_back(distribution(generator));	
-    }
-    i = bits - i;
-    if(i != BigInt::ZERO){
-        //Should be somewhere between 1 and this->bits
-        auto bits_left = i.limbs[0];
-        std::uniform_int_distribution<limb_t> extra_distribution(0, (1 << bits_left) -1);
-        result.limbs.push_back(extra_distribution(generator));
-    }
-
-    return result;
-}
-
-BigInt BigInt::genRandomNum(const BigInt& high) {
-    BigInt bits = log2(high);
-    BigInt result = genRandomBits(bits);
-    //Result has at least a 50% chance of being lesser than high, and so the probability of generating
-    //a number less than high converges to 1 exponentially quickly
-    while(result >= high) {
-        result = genRandomBits(bits);
-    }
-    return result;
-}
-
-
-BigInt BigInt::genRandomNum(const BigInt& low, const BigInt& high) {
-    BigInt diff = high - low;
-    BigInt result = low;
-    result += genRandomNum(diff);
-    return result;
-}
-
-
 bool BigInt::checkFermatWitness(const BigInt& witness) const {
-    auto res = witness.pow((*this - BigInt::ONE), *this);
+    auto res = witness == BigInt::TWO ? pow2mod(*this - BigInt::ONE, *this) : witness.pow((*this - BigInt::ONE), *this);
 
     return res == BigInt::ONE;
 }
@@ -1316,14 +1526,10 @@ bool BigInt::checkMillerRabinWitness(const BigInt& witness) const {
     auto exponent = *this - BigInt::ONE;         
     auto minus_one = exponent;
 
-    auto trailing_zeroes = 0;
+    int trailing_zeroes = exponent.countTrailingZeros();
+    exponent >>= trailing_zeroes;
 
-    while((exponent.limbs[0] & 1) == 0) {
-        ++trailing_zeroes;
-        exponent = exponent.rshift(1);
-    }
-
-    auto res = witness.pow(exponent, *this);
+    auto res = witness == BigInt::TWO ? pow2mod(exponent, *this) : witness.pow(exponent, *this);
 
     if(res == BigInt::ONE || res == minus_one) {
         return true;
@@ -1344,31 +1550,24 @@ bool BigInt::checkMillerRabinWitness(const BigInt& witness) const {
 //The number of strong liars (witnesses to a composite) is bounded
 //above by phi(n) / 4, so Pr[num is not prime | num passes miller rabin test with k rounds] <= 1/4^k
 bool BigInt::millerRabinLikelyPrime(int k) const {
+    BIGINT_STATS_SCOPE(MILLER_RABIN, size());
     assert(*this > 4);
     //make sure the number is odd
-    assert((this->limbs[0] & 1) == 1);
-
-    for(int i = 0; i < k; ++i) {
-        auto witness = genRandomNum(BigInt::TWO, *this - BigInt::TWO);              
+    assert(this->isOdd());
 
-        auto res = this->checkMillerRabinWitness(witness);
-        if(!res) {
-            return false;
-        }
-
-    }
-
-    return true;
+    //d, s and the recoding of d are shared by every witness
+    MillerRabinTester tester(*this);
+    return tester.testRandom(k, threadRandom());
 }
 
-bool BigInt::isLikelyPrime(const BigInt& num) {
+static const std::array<limb_t, 62> small_primes = {
+    2,3,5,7,11,13,17,19,23,29,31,37,41,43,47,53,59,61,67,71,73,79,83,
+    89,97,101,103,107,109,113,127,131,137,139,149,151,157,163,167,
+    173,179,181,191,193,197,199,211,223,227,229,233,239,241,
+    251,257,263,269,271,277,281,283,293
+};
 
-    static std::array<limb_t, 62> small_primes = {
-        2,3,5,7,11,13,17,19,23,29,31,37,41,43,47,53,59,61,67,71,73,79,83,
-        89,97,101,103,107,109,113,127,131,137,139,149,151,157,163,167,
-        173,179,181,191,193,197,199,211,223,227,229,233,239,241,
-        251,257,263,269,271,277,281,283,293
-    };
+bool BigInt::isLikelyPrime(const BigInt& num) {
 
     //Check if number is divisible by small primes
     for(auto small_prime : small_primes) {
@@ -1380,6 +1579,22 @@ bool BigInt::isLikelyPrime(const BigInt& num) {
             return false;
         }   
     }    
+    //Numbers of a few special forms have deterministic tests
+    if((num + BigInt::ONE).popcount() == 1) {
+        return isMersennePrime(num.bitLength());
+    }
+    {
+        BigInt below = num - BigInt::ONE;
+        size_t n = below.countTrailingZeros();
+        //below = k 2^n with k < 2^n
+        if(below.bitLength() - n <= n) {
+            BigInt k = below >> n;
+            if(k == BigInt::ONE && (n & (n - 1)) == 0) {
+                return isFermatPrime(log2(n));
+            }
+            return isProthPrime(k, n);
+        }
+    }
     //fermat test covers many non-primes
     {
         auto res = num.checkFermatWitness(2);
@@ -1417,8 +1632,301 @@ BigInt BigInt::genLikelyPrime(const BigInt& low, const BigInt& high) {
 }
 
 
-BigInt BigInt::genPrime(const BigInt& low,  const BigInt& high) {
+//Deterministic trial division, only intended for n < 2^32 so that at most 2^15 divisions are needed
+bool BigInt::isSmallPrime(limb_t n) {
+    if(n < 2) return false;
+    if((n & 1) == 0) return n == 2;
+    for(limb_t d = 3; d * d <= n; d += 2) {
+        if(n % d == 0) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    return BigInt::ZERO;
+//Jacobi symbol (a/n) for odd n
+static int jacobi(limb_t a, limb_t n) {
+    int result = 1;
+    a %= n;
+    while(a != 0) {
+        while((a & 1) == 0) {
+            a >>= 1;
+            if((n & 7) == 3 || (n & 7) == 5) {
+                result = -result;
+            }
+        }
+        std::swap(a, n);
+        if((a & 3) == 3 && (n & 3) == 3) {
+            result = -result;
+        }
+        a %= n;
+    }
+    return n == 1 ? result : 0;
+}
+
+//(a/n) for odd n > a, reduced to single limbs by quadratic reciprocity
+static int jacobi(limb_t a, const BigInt& n) {
+    int result = 1;
+    limb_t n8 = n.limbs[0] & 7;
+    while(a != 0 && (a & 1) == 0) {
+        a >>= 1;
+        if(n8 == 3 || n8 == 5) {
+            result = -result;
+        }
+    }
+    if(a == 1) {
+        return result;
+    }
+    if((a & 3) == 3 && (n8 & 3) == 3) {
+        result = -result;
+    }
+    BigInt r = n % BigInt(a);
+    return result * jacobi(r.limbs[0], a);
+}
+
+/*
+ * Lucas-Lehmer: for an odd prime p, 2^p - 1 is prime iff s_(p-2) = 0 mod 2^p - 1, where s_0 = 4 and
+ * s_(i+1) = s_i^2 - 2. A composite p makes 2^p - 1 composite. The squarings reduce by folding.
+ */
+bool BigInt::isMersennePrime(size_t p) {
+    BIGINT_STATS_SCOPE(LUCAS_LEHMER, p / 31 + 1);
+    if(p == 2) {
+        return true;
+    }
+    if(!isSmallPrime(p)) {
+        return false;
+    }
+    BigInt m = (BigInt::ONE << p) - BigInt::ONE;
+    BigInt s(4);
+    for(size_t i = 2; i < p; ++i) {
+        s *= s;
+        s %= m;
+        s.subReduced(BigInt::TWO, m);
+    }
+    return s.isZero();
+}
+
+/*
+ * Proth's theorem: N = k 2^n + 1 with odd k < 2^n is prime iff a^((N-1)/2) = -1 mod N for some a, and
+ * for a quadratic non-residue a the converse holds too, so one exponentiation decides it. The
+ * non-residue is looked for among the small primes; other k and n go to isLikelyPrime.
+ */
+bool BigInt::isProthPrime(const BigInt& k, size_t n) {
+    BIGINT_STATS_SCOPE(PROTH, k.size() + n / 31);
+    BigInt odd_k = k;
+    size_t tz = odd_k.countTrailingZeros();
+    odd_k >>= tz;
+    n += tz;
+    BigInt num = (odd_k << n) + BigInt::ONE;
+    if(n == 0 || odd_k.isZero() || odd_k.bitLength() > n) {
+        return isLikelyPrime(num);
+    }
+
+    for(auto a : small_primes) {
+        if(num == a) {
+            return true;
+        }
+        int symbol = jacobi(a, num);
+        if(symbol == 0) {
+            return false;
+        }
+        if(symbol == -1) {
+            return BigInt(a).pow(odd_k << (n - 1), num) == num - BigInt::ONE;
+        }
+    }
+    //Every small prime being a residue all but means a square
+    return num.millerRabinLikelyPrime(10);
+}
+
+//Pepin: F_m = 2^(2^m) + 1 is prime iff 3^((F_m - 1)/2) = -1 mod F_m, for m > 0
+bool BigInt::isFermatPrime(size_t m) {
+    if(m == 0) {
+        return true;
+    }
+    size_t n = static_cast<size_t>(1) << m;
+    BigInt f = (BigInt::ONE << n) + BigInt::ONE;
+    return BigInt(3).pow(BigInt::ONE << (n - 1), f) == f - BigInt::ONE;
+}
+
+//Walks upwards from a random point in [low, high], wrapping around once, so returns 0 only if there is no prime in the range
+limb_t BigInt::genSmallPrime(limb_t low, limb_t high) {
+    if(high < 2 || high < low) return 0;
+    if(low < 2) low = 2;
+
+    BigInt start = genRandomNum(BigInt(low), BigInt(high + 1));
+    limb_t n = 0;
+    for(int i = start.size() -1; i >= 0; --i) {
+        n = (n << start.bits) | start.limbs[i];
+    }
+
+    for(limb_t i = 0; i <= high - low; ++i) {
+        if(isSmallPrime(n)) {
+            return n;
+        }
+        n = n == high ? low : n + 1;
+    }
+    return 0;
+}
+
+/*
+ * Pocklington's criterion for p - 1 = q * r with q prime and q > sqrt(p) - 1: if a^(p-1) = 1 mod p
+ * and gcd(a^r - 1, p) = 1 then p is prime. Only the two modular conditions are checked here,
+ * the caller is responsible for the size and divisibility requirements on q.
+ */
+bool BigInt::checkPocklington(const BigInt& p, const BigInt& q, const BigInt& a) {
+    BigInt r = (p - BigInt::ONE) / q;
+    BigInt x = a.pow(r, p);
+    if(x == BigInt::ZERO) {
+        return false;
+    }
+    //a^(p-1) = (a^r)^q, so the Fermat condition costs only the remaining bits of the exponent
+    if(x.pow(q, p) != BigInt::ONE) {
+        return false;
+    }
+    return (x - BigInt::ONE).gcd(p) == BigInt::ONE;
+}
+
+/*
+ * Shawe-Taylor style recursive construction of a provable prime in [low, high]. A prime q with
+ * q^2 > high is generated recursively, then candidates p = 2kq + 1 in the range are sieved with the
+ * small primes and proven with Pocklington's criterion. Below 2^32 primes are found by trial division.
+ * If certificate is non-null the chain of proofs, smallest prime first, is appended to it.
+ * Returns BigInt::ZERO if the range is too narrow to contain any candidate or none was found.
+ */
+BigInt BigInt::genPrime(const BigInt& low,  const BigInt& high, std::vector<PocklingtonStep> * certificate) {
+    if(high < low || high < BigInt::TWO) {
+        return BigInt::ZERO;
+    }
+
+    auto toLimb = [](const BigInt& n) {
+        limb_t r = 0;
+        for(int i = n.size() -1; i >= 0; --i) {
+            r = (r << n.bits) | n.limbs[i];
+        }
+        return r;
+    };
+    limb_t high_bits = high.bitLength();
+
+    if(high_bits <= 32) {
+        limb_t p = genSmallPrime(low < BigInt::ZERO ? 0 : toLimb(low), toLimb(high));
+        if(p == 0) {
+            return BigInt::ZERO;
+        }
+        if(certificate != nullptr) {
+            certificate->push_back(PocklingtonStep{BigInt(p), BigInt::ZERO, BigInt::ZERO});
+        }
+        return BigInt(p);
+    }
+
+    size_t certificate_size = certificate != nullptr ? certificate->size() : 0;
+    auto fail = [&]() {
+        if(certificate != nullptr) {
+            certificate->resize(certificate_size);
+        }
+        return BigInt::ZERO;
+    };
+
+    //q >= 2^ceil(high_bits / 2) so that q^2 > high >= p
+    BigInt q_low = BigInt::ONE << ((high_bits + 1) / 2);
+    BigInt q = genPrime(q_low, q_low + q_low - BigInt::ONE, certificate);
+    if(q == BigInt::ZERO) {
+        return fail();
+    }
+
+    //2kq + 1 in [low, high]  <=>  ceil((low - 1) / 2q) <= k <= floor((high - 1) / 2q)
+    BigInt two_q = q + q;
+    BigInt k_min = BigInt::ONE;
+    if(low > BigInt::TWO) {
+        k_min = (low - BigInt::TWO) / two_q + BigInt::ONE;
+    }
+    BigInt k_max = (high - BigInt::ONE) / two_q;
+    if(k_max < k_min) {
+        return fail();
+    }
+
+    BigInt k = genRandomNum(k_min, k_max + BigInt::ONE);
+    BigInt p = two_q * k + BigInt::ONE;
+
+    //Same explicit limit as genLikelyPrime
+    for(auto i = 0; i < 10000; ++i) {
+        bool candidate = true;
+        for(auto small_prime : small_primes) {
+            auto res = p % small_prime;
+            if(res == BigInt::ZERO) {
+                candidate = false;
+                break;
+            }
+        }
+
+        if(candidate && checkPocklington(p, q, BigInt::TWO)) {
+            if(certificate != nullptr) {
+                certificate->push_back(PocklingtonStep{p, q, BigInt::TWO});
+            }
+            return p;
+        }
+
+        //Step through the candidates as in Shawe-Taylor, wrapping around at the top of the range
+        if(k == k_max) {
+            k = k_min;
+            p = two_q * k + BigInt::ONE;
+        } else {
+            ++k;
+            p += two_q;
+        }
+    }
+
+    return fail();
+}
+
+//Checks every link of a certificate produced by genPrime, the certified prime is certificate.back().p
+bool BigInt::verifyPrimeCertificate(const std::vector<PocklingtonStep>& certificate) {
+    if(certificate.empty()) {
+        return false;
+    }
+
+    for(auto it = certificate.begin(); it < certificate.end(); ++it) {
+        if(it->p <= BigInt::ONE || it->p.negative) {
+            return false;
+        }
+
+        if(it->q == BigInt::ZERO) {
+            if(it->p.bitLength() > 32) {
+                return false;
+            }
+            limb_t n = 0;
+            for(int i = it->p.size() -1; i >= 0; --i) {
+                n = (n << it->p.bits) | it->p.limbs[i];
+            }
+            if(!isSmallPrime(n)) {
+                return false;
+            }
+            continue;
+        }
+
+        //q must have been proven by an earlier link
+        bool proven = false;
+        for(auto prev = certificate.begin(); prev < it; ++prev) {
+            if(prev->p == it->q) {
+                proven = true;
+                break;
+            }
+        }
+        if(!proven) {
+            return false;
+        }
+
+        BigInt q_plus_one = it->q + BigInt::ONE;
+        if(q_plus_one * q_plus_one <= it->p) {
+            return false;
+        }
+        if((it->p - BigInt::ONE) % it->q != BigInt::ZERO) {
+            return false;
+        }
+        if(!checkPocklington(it->p, it->q, it->a)) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
@@ -0,0 +1,637 @@
+#include "BigInt.h"
+
+/**
+ * GCD
+ *
+ * Lehmer's algorithm runs the Euclidean algorithm on the leading 62 bits of the operands, which fit in
+ * a machine word, and only touches the full numbers to apply the resulting 2x2 cofactor matrix once
+ * per ~31 bits of progress. Operands that fit in a word are finished off with Stein's binary algorithm,
+ * and very large operands are first cut down with a recursive half-gcd so that
+ * the cost is dominated by a few large (Karatsuba) multiplications instead of a quadratic number of
+ * Lehmer steps.
+ */
+
+//gcd() only switches to the half-gcd at this many limbs, with the current Karatsuba multiplication
+//the crossover against plain Lehmer is around a million bits
+static const size_t HALF_GCD_LIMBS = 32000;
+//Below this many limbs the half-gcd recursion bottoms out into Lehmer steps
+static const size_t HALF_GCD_BASE_LIMBS = 2500;
+
+static void trim(BigInt& n) {
+    while(n.limbs.size() > 1) {
+        if(n.limbs.back() != 0) { break; }
+        n.limbs.pop_back();
+    }
+    if(n.limbs.empty()) {
+        n.limbs.push_back(0);
+    }
+    if(n.limbs.size() == 1 && n.limbs[0] == 0) {
+        n.negative = false;
+    }
+}
+
+static void negate(BigInt& n) {
+    if(!n.isZero()) {
+        n.negative = !n.negative;
+    }
+}
+
+//Returns n >> shift, the caller guarantees that the result fits in 62 bits
+static limb_t topBits(const BigInt& n, size_t shift) {
+    size_t li = shift / n.bits;
+    int off = shift % n.bits;
+
+    limb_t r = 0;
+    if(li < n.size()) r = n.limbs[li] >> off;
+    if(li + 1 < n.size()) r |= n.limbs[li + 1] << (n.bits - off);
+    if(li + 2 < n.size()) r |= n.limbs[li + 2] << (2 * n.bits - off);
+    return r;
+}
+
+static limb_t toLimb(const BigInt& n) {
+    limb_t r = 0;
+    for(int i = n.size() -1; i >= 0; --i) {
+        r = (r << n.bits) | n.limbs[i];
+    }
+    return r;
+}
+
+//n = l * n for the 2x2 matrices stored row-major
+static void composeMatrix(const BigInt l[4], BigInt n[4]) {
+    BigInt n0 = l[0] * n[0] + l[1] * n[2];
+    BigInt n1 = l[0] * n[1] + l[1] * n[3];
+    BigInt n2 = l[2] * n[0] + l[3] * n[2];
+    BigInt n3 = l[2] * n[1] + l[3] * n[3];
+    trim(n0); trim(n1); trim(n2); trim(n3);
+    n[0] = std::move(n0);
+    n[1] = std::move(n1);
+    n[2] = std::move(n2);
+    n[3] = std::move(n3);
+}
+
+/*
+ * (a, b) = m * (a, b) for a matrix that was computed from truncated operands. The result can come out
+ * negative or out of order, in which case the rows of m are adjusted to match; any such matrix still has
+ * determinant +-1 so the gcd is unchanged.
+ */
+static void applyMatrix(BigInt& a, BigInt& b, BigInt m[4]) {
+    BigInt x = m[0] * a + m[1] * b;
+    BigInt y = m[2] * a + m[3] * b;
+    trim(x);
+    trim(y);
+
+    if(x.negative) {
+        negate(x);
+        negate(m[0]);
+        negate(m[1]);
+    }
+    if(y.negative) {
+        negate(y);
+        negate(m[2]);
+        negate(m[3]);
+    }
+    if(x < y) {
+        x.swap(y);
+        m[0].swap(m[2]);
+        m[1].swap(m[3]);
+    }
+
+    a = std::move(x);
+    b = std::move(y);
+}
+
+//Stein's algorithm, used once both operands fit in a single machine word
+limb_t BigInt::binaryGcd(limb_t u, limb_t v) {
+    if(u == 0) return v;
+    if(v == 0) return u;
+
+    int shift = __builtin_ctzll(u | v);
+    u >>= __builtin_ctzll(u);
+    do {
+        v >>= __builtin_ctzll(v);
+        if(u > v) {
+            std::swap(u, v);
+        }
+        v -= u;
+    } while(v != 0);
+
+    return u << shift;
+}
+
+/*
+ * Knuth's algorithm L: runs Euclid on the leading 62 bits of a >= b for as long as the quotients are
+ * guaranteed to match those of the full numbers. The cofactors are kept below 2^bits so that applying
+ * them to a limb cannot overflow. Returns false if not even one step could be determined.
+ */
+bool BigInt::lehmerMatrix(const BigInt& a, const BigInt& b, long long m[4]) {
+    size_t shift = a.bitLength() - 62;
+    long long x = topBits(a, shift);
+    long long y = topBits(b, shift);
+    const long long limit = 1LL << a.bits;
+
+    long long A = 1, B = 0, C = 0, D = 1;
+    while(y + C > 0 && y + D > 0 && x + A >= 0 && x + B >= 0) {
+        long long q = (x + A) / (y + C);
+        if(q != (x + B) / (y + D)) {
+            break;
+        }
+
+        long long next_c = A - q * C;
+        long long next_d = B - q * D;
+        if(next_c >= limit || next_c <= -limit || next_d >= limit || next_d <= -limit) {
+            break;
+        }
+
+        A = C;
+        B = D;
+        C = next_c;
+        D = next_d;
+        long long t = x - q * y;
+        x = y;
+        y = t;
+    }
+
+    m[0] = A;
+    m[1] = B;
+    m[2] = C;
+    m[3] = D;
+    return B != 0;
+}
+
+/*
+ * (a, b) = (m0 * a + m1 * b, m2 * a + m3 * b) in a single pass. Each row of m has one non-positive and
+ * one non-negative entry, so with |m| < 2^bits every fused multiply-subtract stays within 63 bits.
+ */
+void BigInt::applyLehmerMatrix(BigInt& a, BigInt& b, const long long m[4]) {
+    size_t n = a.size();
+    b.limbs.resize(n, 0);
+
+    long long carry_a = 0, carry_b = 0;
+    long long mask = a.base - 1;
+    for(size_t i = 0; i < n; ++i) {
+        long long x = a.limbs[i];
+        long long y = b.limbs[i];
+        long long s = m[0] * x + m[1] * y + carry_a;
+        long long t = m[2] * x + m[3] * y + carry_b;
+        a.limbs[i] = s & mask;
+        b.limbs[i] = t & mask;
+        //Arithmetic shift, so the borrow is carried as a negative number
+        carry_a = s >> a.bits;
+        carry_b = t >> a.bits;
+    }
+
+    trim(a);
+    trim(b);
+}
+
+/*
+ * Same as applyLehmerMatrix but for the cofactors: columns of the accumulated matrix alternate in sign
+ * exactly as the rows of m do, so the magnitudes only ever get added, (u, v) = (|m0| u + |m1| v, |m2| u + |m3| v)
+ */
+void BigInt::applyCofactorMatrix(BigInt& u, BigInt& v, const long long m[4]) {
+    size_t n = std::max(u.size(), v.size());
+    u.limbs.resize(n, 0);
+    v.limbs.resize(n, 0);
+
+    limb_t m0 = std::abs(m[0]), m1 = std::abs(m[1]), m2 = std::abs(m[2]), m3 = std::abs(m[3]);
+    limb_t carry_u = 0, carry_v = 0;
+    for(size_t i = 0; i < n; ++i) {
+        limb_t x = u.limbs[i];
+        limb_t y = v.limbs[i];
+        limb_t s = m0 * x + m1 * y + carry_u;
+        limb_t t = m2 * x + m3 * y + carry_v;
+        u.limbs[i] = s & (u.base - 1);
+        v.limbs[i] = t & (u.base - 1);
+        carry_u = s >> u.bits;
+        carry_v = t >> u.bits;
+    }
+    while(carry_u || carry_v) {
+        u.limbs.push_back(carry_u & (u.base - 1));
+        v.limbs.push_back(carry_v & (u.base - 1));
+        carry_u >>= u.bits;
+        carry_v >>= u.bits;
+    }
+
+    trim(u);
+    trim(v);
+}
+
+/*
+ * The base case of halfGcd: Lehmer steps until b has at most m bits. The cofactors are tracked as
+ * magnitudes, their signs follow from the parity of the number of Euclidean steps taken.
+ */
+void BigInt::lehmerReduce(BigInt& a, BigInt& b, size_t m, BigInt * n) {
+    BigInt u0 = BigInt::ONE, u1 = BigInt::ZERO;
+    BigInt v0 = BigInt::ZERO, v1 = BigInt::ONE;
+    bool odd = false;
+
+    while(!b.isZero() && b.bitLength() > m) {
+        long long l[4];
+        if(a.size() > 2 && lehmerMatrix(a, b, l)) {
+            applyLehmerMatrix(a, b, l);
+            if(n != nullptr) {
+                applyCofactorMatrix(u0, v0, l);
+                applyCofactorMatrix(u1, v1, l);
+                odd ^= l[3] < 0;
+            }
+        } else {
+            BigInt q = a / b;
+            a.submul(q, b);
+            trim(a);
+            a.swap(b);
+            if(n != nullptr) {
+                u0.swap(v0);
+                u1.swap(v1);
+                v0.addmul(q, u0);
+                v1.addmul(q, u1);
+                odd = !odd;
+            }
+        }
+    }
+
+    if(n != nullptr) {
+        //Even: [[+, -], [-, +]], odd: [[-, +], [+, -]]
+        n[0] = std::move(u0);
+        n[1] = std::move(u1);
+        n[2] = std::move(v0);
+        n[3] = std::move(v1);
+        negate(n[odd ? 0 : 1]);
+        negate(n[odd ? 3 : 2]);
+    }
+}
+
+/*
+ * Reduces a >= b until b has at most half of the original bit length of a. If n is non-null it receives
+ * the unimodular matrix with (a, b)_new = n * (a, b)_old.
+ *
+ * The top half of a is reduced recursively and the resulting matrix applied to the full numbers, which
+ * reduces a to about 3/4 of its length; a second recursive call on the top of what is left finishes
+ * the job. Each level costs a constant number of multiplications of the matrix entries, giving
+ * O(M(n) log n) overall. As the matrices are computed from truncated numbers the reduction can fall
+ * somewhat short, but never changes the gcd, and gcd() makes up for any shortfall with Lehmer steps.
+ */
+void BigInt::halfGcd(BigInt& a, BigInt& b, BigInt * n) {
+    BIGINT_STATS_SCOPE(HALF_GCD, a.size() + b.size());
+    if(n != nullptr) {
+        n[0] = BigInt::ONE;
+        n[1] = BigInt::ZERO;
+        n[2] = BigInt::ZERO;
+        n[3] = BigInt::ONE;
+    }
+
+    size_t m = a.bitLength() / 2;
+    if(b.bitLength() <= m) {
+        return;
+    }
+
+    auto divisionStep = [&]() {
+        BigInt q = a / b;
+        a.submul(q, b);
+        trim(a);
+        a.swap(b);
+        if(n != nullptr) {
+            n[0].submul(q, n[2]);
+            n[1].submul(q, n[3]);
+            trim(n[0]);
+            trim(n[1]);
+            n[0].swap(n[2]);
+            n[1].swap(n[3]);
+        }
+    };
+
+    if(a.size() < HALF_GCD_BASE_LIMBS) {
+        lehmerReduce(a, b, m, n);
+        return;
+    }
+
+    //Stage 1: the top half of a
+    BigInt a1 = a >> m;
+    BigInt b1 = b >> m;
+    BigInt n1[4];
+    halfGcd(a1, b1, n1);
+    applyMatrix(a, b, n1);
+    if(n != nullptr) {
+        for(int i = 0; i < 4; ++i) {
+            n[i] = std::move(n1[i]);
+        }
+    }
+
+    if(b.isZero() || b.bitLength() <= m) {
+        return;
+    }
+    divisionStep();
+    if(b.isZero() || b.bitLength() <= m) {
+        return;
+    }
+
+    //Stage 2: what remains above m bits, which should now be about a quarter of the original length
+    size_t l = a.bitLength();
+    if(l >= 2 * m) {
+        return;
+    }
+    a1 = a >> (2 * m - l);
+    b1 = b >> (2 * m - l);
+    halfGcd(a1, b1, n1);
+    applyMatrix(a, b, n1);
+    if(n != nullptr) {
+        composeMatrix(n1, n);
+    }
+}
+
+//Always returns a non-negative value, with gcd(x, 0) = |x|
+BigInt BigInt::gcd(const BigInt& rhs) const {
+    BIGINT_STATS_SCOPE(GCD, size() + rhs.size());
+    BigInt a(*this), b(rhs);
+    a.negative = false;
+    b.negative = false;
+    trim(a);
+    trim(b);
+    if(a < b) {
+        a.swap(b);
+    }
+
+    while(!b.isZero()) {
+        if(a.size() <= 2) {
+            return BigInt(binaryGcd(toLimb(a), toLimb(b)));
+        }
+
+        if(a.size() >= HALF_GCD_LIMBS) {
+            size_t before = a.bitLength();
+            halfGcd(a, b, nullptr);
+            if(a.bitLength() < before) {
+                continue;
+            }
+        }
+
+        long long m[4];
+        if(lehmerMatrix(a, b, m)) {
+            applyLehmerMatrix(a, b, m);
+        } else {
+            BigInt r = a % b;
+            trim(r);
+            a.swap(b);
+            b.swap(r);
+        }
+    }
+
+    return a;
+}
+
+/**
+ * Modular inversion
+ *
+ * lehmerInverse is the extended Euclidean algorithm driven by the same Lehmer matrices as gcd(), only
+ * the cofactor of x is carried along and updated with applyCofactorMatrix. binaryInverse is the binary
+ * extended gcd for odd moduli: 31 binary steps are run on word sized approximations of the operands
+ * (low 31 bits and top 33 bits) and the resulting update factors applied to the full numbers in a single
+ * pass. Each pass divides the operands by 2^31, which for the cofactors is exactly one Montgomery
+ * reduction step with R = 2^31, so they never leave [0, mod).
+ */
+
+//Exact Euclidean steps on two words, collecting the matrix until the cofactors reach 2^bits.
+//Returns false if not even one step fits.
+static bool wordMatrix(limb_t& x, limb_t& y, int bits, long long m[4]) {
+    const long long limit = 1LL << bits;
+    long long A = 1, B = 0, C = 0, D = 1;
+    while(y != 0) {
+        limb_t q = x / y;
+        if(q >= static_cast<limb_t>(limit)) {
+            break;
+        }
+        long long next_c = A - static_cast<long long>(q) * C;
+        long long next_d = B - static_cast<long long>(q) * D;
+        if(next_c >= limit || next_c <= -limit || next_d >= limit || next_d <= -limit) {
+            break;
+        }
+        A = C;
+        B = D;
+        C = next_c;
+        D = next_d;
+        limb_t t = x - q * y;
+        x = y;
+        y = t;
+    }
+
+    m[0] = A;
+    m[1] = B;
+    m[2] = C;
+    m[3] = D;
+    return B != 0;
+}
+
+/*
+ * Inverse of 0 <= x < mod. Euclid on (mod, x) keeps a = +-ta * x and b = -+tb * x (mod mod) where the
+ * signs alternate with every step, so only the magnitudes are stored.
+ */
+BigInt BigInt::lehmerInverse(const BigInt& x, const BigInt& mod) {
+    BIGINT_STATS_SCOPE(INV_LEHMER, mod.size());
+    BigInt a(mod), b(x);
+    BigInt ta = BigInt::ZERO, tb = BigInt::ONE;
+    bool odd = false;
+
+    //One Euclidean step with a full quotient, for when no matrix can be formed
+    auto divisionStep = [&](const BigInt& q) {
+        a.submul(q, b);
+        trim(a);
+        a.swap(b);
+        ta.swap(tb);
+        tb.addmul(q, ta);
+        trim(tb);
+        odd = !odd;
+    };
+
+    while(!b.isZero()) {
+        long long m[4];
+        if(a.size() <= 2) {
+            limb_t x = toLimb(a), y = toLimb(b);
+            while(y != 0) {
+                if(wordMatrix(x, y, a.bits, m)) {
+                    applyCofactorMatrix(ta, tb, m);
+                    odd ^= m[3] < 0;
+                } else {
+                    a = BigInt(x);
+                    b = BigInt(y);
+                    divisionStep(BigInt(x / y));
+                    x = toLimb(a);
+                    y = toLimb(b);
+                }
+            }
+            a = BigInt(x);
+            b = BigInt::ZERO;
+            break;
+        }
+
+        if(lehmerMatrix(a, b, m)) {
+            applyLehmerMatrix(a, b, m);
+            applyCofactorMatrix(ta, tb, m);
+            odd ^= m[3] < 0;
+        } else {
+            divisionStep(a / b);
+        }
+    }
+
+    if(a != BigInt::ONE) {
+        return BigInt::ZERO;
+    }
+    //After an odd number of steps a holds what was b, whose cofactor started out positive
+    if(!odd && !ta.isZero()) {
+        BigInt tmp(mod);
+        tmp -= ta;
+        return tmp;
+    }
+    return ta;
+}
+
+/*
+ * out = (f * u + g * v) / 2^bits for limb vectors of length n, with the division exact.
+ * Returns the sign of the result and stores its magnitude.
+ */
+static bool combineShift(const std::vector<limb_t>& u, const std::vector<limb_t>& v, long long f, long long g,
+        int bits, std::vector<limb_t>& out) {
+    size_t n = u.size();
+    long long mask = (1LL << bits) - 1;
+    out.assign(n, 0);
+
+    long long carry = (f * static_cast<long long>(u[0]) + g * static_cast<long long>(v[0])) >> bits;
+    for(size_t i = 1; i < n; ++i) {
+        long long s = f * static_cast<long long>(u[i]) + g * static_cast<long long>(v[i]) + carry;
+        out[i - 1] = s & mask;
+        carry = s >> bits;
+    }
+
+    bool neg = carry < 0;
+    if(neg) {
+        //-(L + c * 2^(n * bits)) = (~L + 1) + (-c - 1) * 2^(n * bits)
+        carry = -carry - 1;
+        long long c = 1;
+        for(size_t i = 0; i + 1 < n; ++i) {
+            long long s = (mask - static_cast<long long>(out[i])) + c;
+            out[i] = s & mask;
+            c = s >> bits;
+        }
+        carry += c;
+    }
+    out[n - 1] = carry;
+    return neg;
+}
+
+/*
+ * out = (f * u + g * v) / 2^bits mod mod, with u, v in [0, mod). The low limb is cleared by adding a
+ * multiple of mod (Montgomery reduction) and the result brought back into [0, mod) from (-mod, 2 * mod).
+ */
+static void combineReduce(const std::vector<limb_t>& u, const std::vector<limb_t>& v, long long f, long long g,
+        const std::vector<limb_t>& mod, limb_t mod_inv, int bits, std::vector<limb_t>& out) {
+    size_t n = mod.size();
+    long long mask = (1LL << bits) - 1;
+    out.assign(n, 0);
+
+    long long s = f * static_cast<long long>(u[0]) + g * static_cast<long long>(v[0]);
+    long long q = static_cast<long long>(((static_cast<limb_t>(s) & mask) * mod_inv) & mask);
+    long long carry = (s + q * static_cast<long long>(mod[0])) >> bits;
+    for(size_t i = 1; i < n; ++i) {
+        s = f * static_cast<long long>(u[i]) + g * static_cast<long long>(v[i])
+            + q * static_cast<long long>(mod[i]) + carry;
+        out[i - 1] = s & mask;
+        carry = s >> bits;
+    }
+
+    //out[n - 1] is held in carry until the result is in range
+    auto addMod = [&](long long sign) {
+        long long c = 0;
+        for(size_t i = 0; i + 1 < n; ++i) {
+            long long t = static_cast<long long>(out[i]) + sign * static_cast<long long>(mod[i]) + c;
+            out[i] = t & mask;
+            c = t >> bits;
+        }
+        carry += sign * static_cast<long long>(mod[n - 1]) + c;
+    };
+
+    if(carry < 0) {
+        addMod(1);
+    }
+    bool ge = carry != static_cast<long long>(mod[n - 1]) ? carry > static_cast<long long>(mod[n - 1]) : true;
+    for(int i = n - 2; i >= 0 && carry == static_cast<long long>(mod[n - 1]); --i) {
+        if(out[i] != mod[i]) {
+            ge = out[i] > mod[i];
+            break;
+        }
+    }
+    if(ge) {
+        addMod(-1);
+    }
+    out[n - 1] = carry;
+}
+
+/*
+ * start * x^-1 mod mod for odd mod and 0 <= x < mod, or ZERO if x is not invertible. Invariant:
+ * a = u * x / start and b = v * x / start (mod mod), with b odd throughout and a reaching 0 once b is
+ * the gcd.
+ */
+BigInt BigInt::binaryInverse(const BigInt& x, const BigInt& mod, const BigInt& start) {
+    BIGINT_STATS_SCOPE(INV_BINARY, mod.size());
+    const int bits = mod.bits;
+    const limb_t mask = mod.base - 1;
+    size_t n = mod.size();
+
+    limb_t inv = montInverse(mod);
+
+    BigInt a(x), b(mod);
+    a.limbs.resize(n, 0);
+    std::vector<limb_t> u(start.limbs), v(n, 0), tmp_u, tmp_v;
+    u.resize(n, 0);
+    std::vector<limb_t> tmp_a, tmp_b;
+
+    while(!a.isZero()) {
+        //Low bits and top 33 bits of both operands, aligned to the longer one
+        size_t len = std::max<size_t>(std::max(a.bitLength(), b.bitLength()), 64);
+        limb_t xa = (a.limbs[0] & mask) | (topBits(a, len - 33) << bits);
+        limb_t xb = (b.limbs[0] & mask) | (topBits(b, len - 33) << bits);
+
+        long long f0 = 1, g0 = 0, f1 = 0, g1 = 1;
+        for(int j = 0; j < bits; ++j) {
+            if(xa & 1) {
+                if(xa < xb) {
+                    std::swap(xa, xb);
+                    std::swap(f0, f1);
+                    std::swap(g0, g1);
+                }
+                xa -= xb;
+                f0 -= f1;
+                g0 -= g1;
+            }
+            xa >>= 1;
+            f1 *= 2;
+            g1 *= 2;
+        }
+
+        if(combineShift(a.limbs, b.limbs, f0, g0, bits, tmp_a)) {
+            f0 = -f0;
+            g0 = -g0;
+        }
+        if(combineShift(a.limbs, b.limbs, f1, g1, bits, tmp_b)) {
+            f1 = -f1;
+            g1 = -g1;
+        }
+        a.limbs.swap(tmp_a);
+        b.limbs.swap(tmp_b);
+        //Both operands only ever shrink, drop the limbs that have become zero in both
+        while(a.size() > 1 && a.limbs.back() == 0 && b.limbs.back() == 0) {
+            a.limbs.pop_back();
+            b.limbs.pop_back();
+        }
+
+        combineReduce(u, v, f0, g0, mod.limbs, inv, bits, tmp_u);
+        combineReduce(u, v, f1, g1, mod.limbs, inv, bits, tmp_v);
+        u.swap(tmp_u);
+        v.swap(tmp_v);
+    }
+
+    trim(b);
+    if(b != BigInt::ONE) {
+        return BigInt::ZERO;
+    }
+    BigInt result;
+    result.limbs = std::move(v);
+    trim(result);
+    return result;
+}
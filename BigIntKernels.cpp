@@ -0,0 +1,454 @@
+#include "BigInt.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BIGINT_X86_KERNELS
+#endif
+
+/**
+ * Basecase multiplication kernels
+ *
+ * Limbs hold 31 bits in 64, so a limb product is below 2^62 and is exactly what vpmuludq computes from
+ * the low halves of two 64 bit lanes. The vector kernels add three rows of products to the result per
+ * pass, loading and storing each limb once, and carry every limb one place up in the same pass: it keeps
+ * its low 31 bits and takes the high bits of the limb below. That leaves every limb below 5 2^31, with
+ * room for the next three rows, and a single ripple at the end normalises the result. The scalar kernels
+ * are the reference the vector ones are checked against.
+ */
+
+static const limb_t MASK = (static_cast<limb_t>(1) << 31) - 1;
+
+/*
+ * The vector kernels are compiled for their own instruction sets whatever the build targets, and the
+ * widest one the processor supports is picked the first time a kernel is needed. Setting BIGINT_KERNEL
+ * to scalar, avx2 or avx512 picks that one instead, if the processor supports it, to compare them.
+ */
+static const char * const kernel_names[] = {"scalar", "avx2", "avx512"};
+
+static bool supported(BigInt::MulKernel k) {
+    switch(k) {
+	case BigInt::MulKernel::SCALAR:
+	    return true;
+#if defined(BIGINT_X86_KERNELS)
+	case BigInt::MulKernel::AVX2:
+	    return __builtin_cpu_supports("avx2");
+	case BigInt::MulKernel::AVX512:
+	    return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+	    return false;
+    }
+}
+
+static BigInt::MulKernel detectKernel() {
+#if defined(BIGINT_X86_KERNELS)
+    __builtin_cpu_init();
+#endif
+    const BigInt::MulKernel widest_first[] = {BigInt::MulKernel::AVX512, BigInt::MulKernel::AVX2, BigInt::MulKernel::SCALAR};
+    const char * forced = std::getenv("BIGINT_KERNEL");
+    if(forced != nullptr) {
+	for(auto k : widest_first) {
+	    if(std::strcmp(forced, kernel_names[static_cast<int>(k)]) == 0 && supported(k)) {
+		return k;
+	    }
+	}
+    }
+    for(auto k : widest_first) {
+	if(supported(k)) {
+	    return k;
+	}
+    }
+    return BigInt::MulKernel::SCALAR;
+}
+
+//Threads may multiply while another picks a kernel, relaxed is enough as any kernel gives the same result
+static std::atomic<BigInt::MulKernel>& active() {
+    static std::atomic<BigInt::MulKernel> kernel(detectKernel());
+    return kernel;
+}
+
+BigInt::MulKernel BigInt::mulKernel() {
+    return active().load(std::memory_order_relaxed);
+}
+
+bool BigInt::setMulKernel(MulKernel k) {
+    if(!supported(k)) {
+	return false;
+    }
+    active().store(k, std::memory_order_relaxed);
+    return true;
+}
+
+//Carries x[0, n) through in one pass, the carry out of the top limb is dropped
+static void ripple(limb_t * x, size_t n) {
+    limb_t carry = 0;
+    for(size_t i = 0; i < n; ++i) {
+	limb_t t = x[i] + carry;
+	x[i] = t & MASK;
+	carry = t >> 31;
+    }
+}
+
+/*
+ * dst[0, n + m) = a[0, n) * b[0, m). Every row is added on top of the last, the finished column carried
+ * into the next and the live ones every 4 rows, as 4 products and a carry still fit in 64 bits.
+ */
+static void mulScalar(limb_t * dst, const limb_t * a, size_t n, const limb_t * b, size_t m) {
+    std::fill(dst, dst + n + m, 0);
+    for(size_t i = 0; i < n; ++i) {
+	limb_t * row = dst + i;
+	for(size_t j = 0; j < m; ++j) {
+	    row[j] += a[i] * b[j];
+	}
+	row[1] += row[0] >> 31;
+	row[0] &= MASK;
+	if(i % 4 == 3) {
+	    for(size_t j = 1; j < m; ++j) {
+		row[j + 1] += row[j] >> 31;
+		row[j] &= MASK;
+	    }
+	}
+    }
+    ripple(dst, n + m);
+}
+
+//HAC algorithm 14.16 for squaring, http://cacr.uwaterloo.ca/hac/about/chap14.pdf
+static void sqrScalar(limb_t * dst, const limb_t * a, size_t n) {
+    std::fill(dst, dst + 2 * n, 0);
+    for(size_t i = 0; i < n; ++i) {
+	limb_t uv = dst[i + i] + a[i] * a[i];
+	limb_t c = uv >> 31;
+	dst[i + i] = uv & MASK;
+	for(size_t j = i + 1; j < n; ++j) {
+	    uv = dst[i + j] + 2 * a[i] * a[j] + c;
+	    dst[i + j] = uv & MASK;
+	    c = uv >> 31;
+	}
+	dst[i + n] = c;
+    }
+    ripple(dst, 2 * n);
+}
+
+/*
+ * One pass of the vector kernels: rows r < rows add a[r] * b[c - r] to column c of dst, for the
+ * columns where b[c - r] exists and, with skip set, c - r >= r, which leaves out the products below
+ * the diagonal of a square. Each column is carried one limb up as it is written, keeping its low
+ * 31 bits plus the high bits of the column below, and the carry out of the top column lands in the
+ * column above, which no earlier pass has written. Vector is handed the columns from 2 + 2 skip on,
+ * where every row is in range at the bottom, and returns how far it got, the rest are done here.
+ */
+typedef size_t (*PassVector)(limb_t *, const limb_t *, size_t, const limb_t *, size_t, size_t, size_t, limb_t&);
+
+static inline limb_t passColumn(limb_t * dst, const limb_t * b, size_t len, const limb_t * a, size_t rows, size_t skip,
+	size_t c, limb_t below) {
+    limb_t v = dst[c];
+    for(size_t r = 0; r < rows; ++r) {
+	if(c >= r + r * skip && c - r < len) {
+	    v += a[r] * b[c - r];
+	}
+    }
+    dst[c] = (v & MASK) + below;
+    return v >> 31;
+}
+
+template<PassVector Vector>
+static void pass(limb_t * dst, const limb_t * b, size_t len, const limb_t * a, size_t rows, size_t skip) {
+    const size_t w = len + rows - 1;
+    const size_t first = std::min(w, 2 + 2 * skip);
+    limb_t hi = 0;
+    size_t c = 0;
+    for(; c < first; ++c) {
+	hi = passColumn(dst, b, len, a, rows, skip, c, hi);
+    }
+    c = Vector(dst, b, len, a, rows, c, w, hi);
+    for(; c < w; ++c) {
+	hi = passColumn(dst, b, len, a, rows, skip, c, hi);
+    }
+    dst[w] += hi;
+}
+
+template<PassVector Vector>
+static void mulRows(limb_t * dst, const limb_t * a, size_t n, const limb_t * b, size_t m) {
+    std::fill(dst, dst + n + m, 0);
+    for(size_t i = 0; i < n; i += 3) {
+	pass<Vector>(dst + i, b, m, a + i, std::min<size_t>(3, n - i), 0);
+    }
+    ripple(dst, n + m);
+}
+
+//Row i of a square only needs a[i] * a[j] for j > i, those are summed and then doubled
+template<PassVector Vector>
+static void sqrRows(limb_t * dst, const limb_t * a, size_t n) {
+    std::fill(dst, dst + 2 * n, 0);
+    for(size_t i = 0; i + 1 < n; i += 3) {
+	pass<Vector>(dst + 2 * i + 1, a + i + 1, n - i - 1, a + i, std::min<size_t>(3, n - 1 - i), 1);
+    }
+    //Every limb is below 5 2^31, so doubling and adding a square still fits
+    for(size_t i = 0; i < n; ++i) {
+	dst[2 * i] = 2 * dst[2 * i] + a[i] * a[i];
+	dst[2 * i + 1] *= 2;
+    }
+    ripple(dst, 2 * n);
+}
+
+#if defined(BIGINT_X86_KERNELS)
+//Whole vectors only, each lane's carry is moved up by rotating the high bits one lane and taking the bottom one from the last vector
+__attribute__((target("avx2")))
+static size_t passAvx2(limb_t * dst, const limb_t * b, size_t len, const limb_t * a, size_t rows, size_t c, size_t w,
+	limb_t& hi) {
+    const __m256i mask = _mm256_set1_epi64x(MASK);
+    const __m256i a0 = _mm256_set1_epi64x(a[0]);
+    const __m256i a1 = _mm256_set1_epi64x(rows > 1 ? a[1] : 0);
+    const __m256i a2 = _mm256_set1_epi64x(rows > 2 ? a[2] : 0);
+    __m256i below = _mm256_set1_epi64x(hi);
+    for(; c + 4 <= len; c += 4) {
+	__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + c));
+	v = _mm256_add_epi64(v, _mm256_mul_epu32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + c)), a0));
+	v = _mm256_add_epi64(v, _mm256_mul_epu32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + c - 1)), a1));
+	v = _mm256_add_epi64(v, _mm256_mul_epu32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + c - 2)), a2));
+	__m256i up = _mm256_permute4x64_epi64(_mm256_srli_epi64(v, 31), _MM_SHUFFLE(2, 1, 0, 3));
+	__m256i carry = _mm256_blend_epi32(up, below, 0x03);
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + c), _mm256_add_epi64(_mm256_and_si256(v, mask), carry));
+	below = up;
+    }
+    hi = _mm256_extract_epi64(below, 0);
+    return c;
+}
+#endif
+
+#if defined(BIGINT_X86_KERNELS)
+#if defined(__GNUC__) && !defined(__clang__)
+//GCC 12 warns about the undefined vectors its own intrinsics start from
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+//Whole vectors while every row is in range, then masked ones up to the top column
+__attribute__((target("avx512f")))
+static size_t passAvx512(limb_t * dst, const limb_t * b, size_t len, const limb_t * a, size_t rows, size_t c, size_t w,
+	limb_t& hi) {
+    const __m512i mask = _mm512_set1_epi64(MASK);
+    const __m512i coeff[3] = {
+	_mm512_set1_epi64(a[0]), _mm512_set1_epi64(rows > 1 ? a[1] : 0), _mm512_set1_epi64(rows > 2 ? a[2] : 0)
+    };
+    __m512i below = _mm512_set1_epi64(hi);
+    for(; c + 8 <= len; c += 8) {
+	__m512i v = _mm512_loadu_si512(dst + c);
+	v = _mm512_add_epi64(v, _mm512_mul_epu32(_mm512_loadu_si512(b + c), coeff[0]));
+	v = _mm512_add_epi64(v, _mm512_mul_epu32(_mm512_loadu_si512(b + c - 1), coeff[1]));
+	v = _mm512_add_epi64(v, _mm512_mul_epu32(_mm512_loadu_si512(b + c - 2), coeff[2]));
+	__m512i up = _mm512_srli_epi64(v, 31);
+	_mm512_storeu_si512(dst + c, _mm512_add_epi64(_mm512_and_si512(v, mask), _mm512_alignr_epi64(up, below, 7)));
+	below = up;
+    }
+    size_t lanes = 8;
+    for(; c < w; c += 8) {
+	lanes = std::min<size_t>(8, w - c);
+	__m512i v = _mm512_maskz_loadu_epi64(static_cast<__mmask8>((1u << lanes) - 1), dst + c);
+	for(size_t r = 0; r < 3; ++r) {
+	    size_t avail = len > c - r ? std::min<size_t>(8, len - (c - r)) : 0;
+	    __m512i row = _mm512_maskz_loadu_epi64(static_cast<__mmask8>((1u << avail) - 1), b + c - r);
+	    v = _mm512_add_epi64(v, _mm512_mul_epu32(row, coeff[r]));
+	}
+	__m512i up = _mm512_srli_epi64(v, 31);
+	_mm512_mask_storeu_epi64(dst + c, static_cast<__mmask8>((1u << lanes) - 1),
+		_mm512_add_epi64(_mm512_and_si512(v, mask), _mm512_alignr_epi64(up, below, 7)));
+	below = up;
+    }
+    alignas(64) limb_t top[8];
+    _mm512_store_si512(top, below);
+    hi = top[lanes - 1];
+    return c;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+//Below these sizes the passes cost more than the vectors save
+static const size_t VECTOR_MUL_LIMBS = 12;
+static const size_t VECTOR_SQR_LIMBS = 24;
+
+//The longer operand runs along the rows, so there are fewer passes and longer vectors
+void BigInt::mulBasecase(limb_t * dst, const limb_t * a, size_t n, const limb_t * b, size_t m) {
+    if(n > m) {
+	std::swap(a, b);
+	std::swap(n, m);
+    }
+    switch(n < VECTOR_MUL_LIMBS ? MulKernel::SCALAR : mulKernel()) {
+#if defined(BIGINT_X86_KERNELS)
+	case MulKernel::AVX512:
+	    mulRows<passAvx512>(dst, a, n, b, m);
+	    return;
+#endif
+#if defined(BIGINT_X86_KERNELS)
+	case MulKernel::AVX2:
+	    mulRows<passAvx2>(dst, a, n, b, m);
+	    return;
+#endif
+	default:
+	    mulScalar(dst, a, n, b, m);
+    }
+}
+
+void BigInt::sqrBasecase(limb_t * dst, const limb_t * a, size_t n) {
+    switch(n < VECTOR_SQR_LIMBS ? MulKernel::SCALAR : mulKernel()) {
+#if defined(BIGINT_X86_KERNELS)
+	case MulKernel::AVX512:
+	    sqrRows<passAvx512>(dst, a, n);
+	    return;
+#endif
+#if defined(BIGINT_X86_KERNELS)
+	case MulKernel::AVX2:
+	    sqrRows<passAvx2>(dst, a, n);
+	    return;
+#endif
+	default:
+	    sqrScalar(dst, a, n);
+    }
+}
+
+/**
+ * Montgomery multiplication across lanes
+ *
+ * Each lane is an independent product with its own modulus, stored limb by limb so that limb j of every
+ * lane is one vector. The vector kernels then run the scalar montMul vertically: the lanes only ever meet
+ * in the same instruction, never in the same carry chain.
+ */
+
+size_t BigInt::montLanes(MulKernel kernel) {
+    return kernel == MulKernel::AVX512 ? 8 : 4;
+}
+
+//t - mod for the lanes where t >= mod, chosen with a mask: t + (B^n - 1 - mod) + 1 carries out exactly then
+template<size_t L>
+static void montFinish(limb_t * t, const limb_t * mod, size_t n) {
+    limb_t carry[L], take[L];
+    for(size_t l = 0; l < L; ++l) {
+	carry[l] = 1;
+    }
+    for(size_t j = 0; j < n; ++j) {
+	for(size_t l = 0; l < L; ++l) {
+	    carry[l] = (t[j * L + l] + (MASK - mod[j * L + l]) + carry[l]) >> 31;
+	}
+    }
+    for(size_t l = 0; l < L; ++l) {
+	take[l] = 0 - (carry[l] | t[n * L + l]);
+	carry[l] = 1;
+    }
+    for(size_t j = 0; j < n; ++j) {
+	for(size_t l = 0; l < L; ++l) {
+	    limb_t d = t[j * L + l] + (MASK - mod[j * L + l]) + carry[l];
+	    carry[l] = d >> 31;
+	    t[j * L + l] = ((d & MASK) & take[l]) | (t[j * L + l] & ~take[l]);
+	}
+    }
+}
+
+template<size_t L>
+static void montMulLanesScalar(const limb_t * a, const limb_t * b, const limb_t * mod, const limb_t * inv, size_t n, limb_t * t) {
+    std::fill(t, t + (n + 1) * L, 0);
+    limb_t q[L], carry[L];
+    for(size_t i = 0; i < n; ++i) {
+	const limb_t * a_i = a + i * L;
+	for(size_t l = 0; l < L; ++l) {
+	    limb_t u = t[l] + a_i[l] * b[l];
+	    q[l] = ((u & MASK) * inv[l]) & MASK;
+	    carry[l] = (u + q[l] * mod[l]) >> 31;
+	}
+	for(size_t j = 1; j < n; ++j) {
+	    for(size_t l = 0; l < L; ++l) {
+		limb_t s = t[j * L + l] + a_i[l] * b[j * L + l] + q[l] * mod[j * L + l] + carry[l];
+		t[(j - 1) * L + l] = s & MASK;
+		carry[l] = s >> 31;
+	    }
+	}
+	for(size_t l = 0; l < L; ++l) {
+	    limb_t s = t[n * L + l] + carry[l];
+	    t[(n - 1) * L + l] = s & MASK;
+	    t[n * L + l] = s >> 31;
+	}
+    }
+    montFinish<L>(t, mod, n);
+}
+
+#if defined(BIGINT_X86_KERNELS)
+__attribute__((target("avx2")))
+static void montMulLanesAvx2(const limb_t * a, const limb_t * b, const limb_t * mod, const limb_t * inv, size_t n, limb_t * t) {
+    const __m256i mask = _mm256_set1_epi64x(MASK);
+    const __m256i vinv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(inv));
+    __m256i * vt = reinterpret_cast<__m256i *>(t);
+    const __m256i * va = reinterpret_cast<const __m256i *>(a);
+    const __m256i * vb = reinterpret_cast<const __m256i *>(b);
+    const __m256i * vm = reinterpret_cast<const __m256i *>(mod);
+    std::fill(t, t + (n + 1) * 4, 0);
+    for(size_t i = 0; i < n; ++i) {
+	__m256i a_i = _mm256_loadu_si256(va + i);
+	__m256i u = _mm256_add_epi64(_mm256_loadu_si256(vt), _mm256_mul_epu32(a_i, _mm256_loadu_si256(vb)));
+	__m256i q = _mm256_and_si256(_mm256_mul_epu32(_mm256_and_si256(u, mask), vinv), mask);
+	__m256i carry = _mm256_srli_epi64(_mm256_add_epi64(u, _mm256_mul_epu32(q, _mm256_loadu_si256(vm))), 31);
+	for(size_t j = 1; j < n; ++j) {
+	    __m256i s = _mm256_add_epi64(_mm256_loadu_si256(vt + j), _mm256_mul_epu32(a_i, _mm256_loadu_si256(vb + j)));
+	    s = _mm256_add_epi64(s, _mm256_add_epi64(_mm256_mul_epu32(q, _mm256_loadu_si256(vm + j)), carry));
+	    _mm256_storeu_si256(vt + j - 1, _mm256_and_si256(s, mask));
+	    carry = _mm256_srli_epi64(s, 31);
+	}
+	__m256i s = _mm256_add_epi64(_mm256_loadu_si256(vt + n), carry);
+	_mm256_storeu_si256(vt + n - 1, _mm256_and_si256(s, mask));
+	_mm256_storeu_si256(vt + n, _mm256_srli_epi64(s, 31));
+    }
+    montFinish<4>(t, mod, n);
+}
+#endif
+
+#if defined(BIGINT_X86_KERNELS)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f")))
+static void montMulLanesAvx512(const limb_t * a, const limb_t * b, const limb_t * mod, const limb_t * inv, size_t n, limb_t * t) {
+    const __m512i mask = _mm512_set1_epi64(MASK);
+    const __m512i vinv = _mm512_loadu_si512(inv);
+    std::fill(t, t + (n + 1) * 8, 0);
+    for(size_t i = 0; i < n; ++i) {
+	__m512i a_i = _mm512_loadu_si512(a + 8 * i);
+	__m512i u = _mm512_add_epi64(_mm512_loadu_si512(t), _mm512_mul_epu32(a_i, _mm512_loadu_si512(b)));
+	__m512i q = _mm512_and_si512(_mm512_mul_epu32(_mm512_and_si512(u, mask), vinv), mask);
+	__m512i carry = _mm512_srli_epi64(_mm512_add_epi64(u, _mm512_mul_epu32(q, _mm512_loadu_si512(mod))), 31);
+	for(size_t j = 1; j < n; ++j) {
+	    __m512i s = _mm512_add_epi64(_mm512_loadu_si512(t + 8 * j), _mm512_mul_epu32(a_i, _mm512_loadu_si512(b + 8 * j)));
+	    s = _mm512_add_epi64(s, _mm512_add_epi64(_mm512_mul_epu32(q, _mm512_loadu_si512(mod + 8 * j)), carry));
+	    _mm512_storeu_si512(t + 8 * (j - 1), _mm512_and_si512(s, mask));
+	    carry = _mm512_srli_epi64(s, 31);
+	}
+	__m512i s = _mm512_add_epi64(_mm512_loadu_si512(t + 8 * n), carry);
+	_mm512_storeu_si512(t + 8 * (n - 1), _mm512_and_si512(s, mask));
+	_mm512_storeu_si512(t + 8 * n, _mm512_srli_epi64(s, 31));
+    }
+    montFinish<8>(t, mod, n);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+void BigInt::montMulLanes(MulKernel kernel, const limb_t * a, const limb_t * b, const limb_t * mod, const limb_t * inv,
+	size_t n, limb_t * t) {
+    switch(kernel) {
+#if defined(BIGINT_X86_KERNELS)
+	case MulKernel::AVX512:
+	    montMulLanesAvx512(a, b, mod, inv, n, t);
+	    return;
+#endif
+#if defined(BIGINT_X86_KERNELS)
+	case MulKernel::AVX2:
+	    montMulLanesAvx2(a, b, mod, inv, n, t);
+	    return;
+#endif
+	default:
+	    montMulLanesScalar<4>(a, b, mod, inv, n, t);
+    }
+}
@@ -0,0 +1,358 @@
+#include "ModInt.h"
+
+/**
+ * ModRing
+ */
+
+ModRing::ModRing(const BigInt& modulus): mod(modulus), odd(false), inv(0) {
+    mod.negative = false;
+    while(mod.size() > 1 && mod.limbs.back() == 0) {
+	mod.limbs.pop_back();
+    }
+    odd = mod.isOdd();
+    if(odd) {
+	inv = BigInt::montInverse(mod);
+	r1 = BigInt::ONE;
+	r1.lLimbShift(mod.size());
+	r1 %= mod;
+	r2 = BigInt::ONE;
+	r2.lLimbShift(2 * mod.size());
+	r2 %= mod;
+    } else {
+	r1 = BigInt::ONE % mod;
+    }
+}
+
+const BigInt& ModRing::modulus() const {
+    return mod;
+}
+
+bool ModRing::isMontgomery() const {
+    return odd;
+}
+
+ModInt ModRing::operator()(const BigInt& x) const {
+    return ModInt(*this, x);
+}
+
+ModInt ModRing::zero() const {
+    ModInt z;
+    z.r = this;
+    z.rep = BigInt::ZERO;
+    return z;
+}
+
+ModInt ModRing::one() const {
+    ModInt o;
+    o.r = this;
+    o.rep = r1;
+    return o;
+}
+
+BigInt ModRing::toRep(const BigInt& x) const {
+    BigInt reduced(x);
+    if(reduced.negative || reduced >= mod) {
+	bool negative = reduced.negative;
+	reduced.negative = false;
+	reduced %= mod;
+	if(negative) {
+	    reduced.negReduced(mod);
+	}
+    }
+    if(odd) {
+	mul(reduced, r2);
+    }
+    return reduced;
+}
+
+BigInt ModRing::fromRep(const BigInt& x) const {
+    BigInt plain(x);
+    if(odd) {
+	mul(plain, BigInt::ONE);
+    }
+    return plain;
+}
+
+//a = a * b in the ring's representation
+void ModRing::mul(BigInt& a, const BigInt& b) const {
+    if(!odd) {
+	a = a.mod_mul(b, mod);
+	return;
+    }
+    BigInt tmp;
+    BigInt::montMul(a.limbs, b.limbs, mod, inv, tmp.limbs);
+    while(tmp.size() > 1 && tmp.limbs.back() == 0) {
+	tmp.limbs.pop_back();
+    }
+    a.swap(tmp);
+}
+
+/**
+ * ModInt
+ */
+
+ModInt::ModInt(): r(nullptr), rep() {}
+
+ModInt::ModInt(const ModRing& ring, const BigInt& x): r(&ring), rep(ring.toRep(x)) {}
+
+const ModRing& ModInt::ring() const {
+    return *r;
+}
+
+BigInt ModInt::value() const {
+    return r->fromRep(rep);
+}
+
+//Montgomery form maps 0 to 0, so this needs no conversion
+bool ModInt::isZero() const {
+    return rep.isZero();
+}
+
+ModInt& ModInt::operator+=(const ModInt& rhs) {
+    rep.addReduced(rhs.rep, r->mod);
+    return *this;
+}
+
+ModInt& ModInt::operator-=(const ModInt& rhs) {
+    rep.subReduced(rhs.rep, r->mod);
+    return *this;
+}
+
+ModInt& ModInt::operator*=(const ModInt& rhs) {
+    r->mul(rep, rhs.rep);
+    return *this;
+}
+
+ModInt ModInt::operator+(const ModInt& rhs) const {
+    ModInt tmp(*this);
+    tmp += rhs;
+    return tmp;
+}
+
+ModInt ModInt::operator-(const ModInt& rhs) const {
+    ModInt tmp(*this);
+    tmp -= rhs;
+    return tmp;
+}
+
+ModInt ModInt::operator*(const ModInt& rhs) const {
+    ModInt tmp(*this);
+    tmp *= rhs;
+    return tmp;
+}
+
+ModInt ModInt::operator-() const {
+    ModInt tmp(*this);
+    tmp.rep.negReduced(r->mod);
+    return tmp;
+}
+
+//Representations are unique, so they compare directly
+bool ModInt::operator==(const ModInt& rhs) const {
+    return rep == rhs.rep;
+}
+
+bool ModInt::operator!=(const ModInt& rhs) const {
+    return !(*this == rhs);
+}
+
+ModInt ModInt::sqr() const {
+    ModInt tmp(*this);
+    r->mul(tmp.rep, rep);
+    return tmp;
+}
+
+/*
+* 4 bit windows from the top of exp, skipping the multiplication for windows of zeros. A negative exp
+* raises the inverse, which is zero when there is none.
+*/
+ModInt ModInt::pow(const BigInt& exp) const {
+    if(exp.negative && !exp.isZero()) {
+	return inverse().pow(-exp);
+    }
+    ModInt table[16];
+    table[0] = r->one();
+    for(int i = 1; i < 16; ++i) {
+	table[i] = table[i - 1] * *this;
+    }
+
+    ModInt acc = r->one();
+    size_t windows = (exp.bitLength() + 3) / 4;
+    for(size_t w = windows; w-- > 0;) {
+	for(int i = 0; i < 4 && w + 1 < windows; ++i) {
+	    r->mul(acc.rep, acc.rep);
+	}
+	int digit = 0;
+	for(int i = 3; i >= 0; --i) {
+	    digit = (digit << 1) | exp.testBit(4 * w + i);
+	}
+	if(digit != 0) {
+	    acc *= table[digit];
+	}
+    }
+    return acc;
+}
+
+//mont_inv takes and returns Montgomery form directly, so odd moduli need no conversions
+ModInt ModInt::inverse() const {
+    ModInt tmp;
+    tmp.r = r;
+    tmp.rep = r->odd ? rep.mont_inv(r->mod) : rep.mod_inv(r->mod);
+    return tmp;
+}
+
+/*
+* Montgomery's trick on the ring's own products: the prefix products are inverted once and each inverse
+* recovered walking back. If the product has no inverse, every element is inverted on its own.
+*/
+std::vector<size_t> ModInt::batchInverse(std::vector<ModInt>& xs) {
+    std::vector<size_t> bad;
+    std::vector<size_t> good;
+    for(size_t i = 0; i < xs.size(); ++i) {
+	if(xs[i].isZero()) {
+	    bad.push_back(i);
+	} else {
+	    good.push_back(i);
+	}
+    }
+    if(good.empty()) {
+	return bad;
+    }
+
+    std::vector<ModInt> prefix(good.size());
+    prefix[0] = xs[good[0]];
+    for(size_t j = 1; j < good.size(); ++j) {
+	prefix[j] = prefix[j - 1] * xs[good[j]];
+    }
+
+    ModInt inv = prefix.back().inverse();
+    if(inv.isZero()) {
+	for(auto i : good) {
+	    xs[i] = xs[i].inverse();
+	    if(xs[i].isZero()) {
+		bad.push_back(i);
+	    }
+	}
+	std::sort(bad.begin(), bad.end());
+	return bad;
+    }
+
+    for(size_t j = good.size() - 1; j > 0; --j) {
+	ModInt x_inv = inv * prefix[j - 1];
+	inv *= xs[good[j]];
+	xs[good[j]] = std::move(x_inv);
+    }
+    xs[good[0]] = std::move(inv);
+    return bad;
+}
+
+std::ostream& operator<<(std::ostream& out, const ModInt& x) {
+    return out << x.value();
+}
+
+/**
+ * MillerRabinTester
+ */
+
+const size_t MillerRabinTester::LANES;
+
+MillerRabinTester::MillerRabinTester(const BigInt& n): n(n), ring(n), d(n - BigInt::ONE), s(0), window_bits(4) {
+    s = d.countTrailingZeros();
+    d >>= s;
+    one = ring.one();
+    minus_one = -one;
+
+    size_t bits = d.bitLength();
+    window_bits = bits > 1024 ? 6 : bits > 256 ? 5 : 4;
+    //Runs of zeros only square, each window starts and ends with a 1. d is odd, so the last window ends at bit 0
+    size_t pending = 0;
+    for(size_t i = bits; i-- > 0; ) {
+	if(!d.testBit(i)) {
+	    ++pending;
+	    continue;
+	}
+	size_t j = i + 1 >= static_cast<size_t>(window_bits) ? i + 1 - window_bits : 0;
+	while(!d.testBit(j)) {
+	    ++j;
+	}
+	limb_t digit = 0;
+	for(size_t b = i + 1; b-- > j; ) {
+	    digit = (digit << 1) | d.testBit(b);
+	}
+	windows.push_back({pending + i - j + 1, digit});
+	pending = 0;
+	i = j;
+    }
+}
+
+bool MillerRabinTester::test(const BigInt& witness) const {
+    return test(std::vector<BigInt>(1, witness));
+}
+
+bool MillerRabinTester::test(const std::vector<BigInt>& witnesses) const {
+    const size_t entries = static_cast<size_t>(1) << (window_bits - 1);
+    std::vector<ModInt> tables[LANES];
+    ModInt acc[LANES];
+
+    for(size_t first = 0; first < witnesses.size(); first += LANES) {
+	const size_t lanes = std::min(LANES, witnesses.size() - first);
+
+	//table[i] = a^(2i + 1)
+	for(size_t l = 0; l < lanes; ++l) {
+	    ModInt a = ring(witnesses[first + l]);
+	    ModInt a2 = a.sqr();
+	    tables[l].resize(entries);
+	    tables[l][0] = a;
+	    for(size_t i = 1; i < entries; ++i) {
+		tables[l][i] = tables[l][i - 1] * a2;
+	    }
+	    //d is odd, so the first window has a digit and starts the accumulator off
+	    acc[l] = tables[l][windows[0].digit >> 1];
+	}
+
+	for(size_t w = 1; w < windows.size(); ++w) {
+	    for(size_t i = 0; i < windows[w].squarings; ++i) {
+		for(size_t l = 0; l < lanes; ++l) {
+		    acc[l] = acc[l].sqr();
+		}
+	    }
+	    if(windows[w].digit != 0) {
+		for(size_t l = 0; l < lanes; ++l) {
+		    acc[l] *= tables[l][windows[w].digit >> 1];
+		}
+	    }
+	}
+
+	for(size_t l = 0; l < lanes; ++l) {
+	    if(!finish(acc[l])) {
+		return false;
+	    }
+	}
+    }
+    return true;
+}
+
+bool MillerRabinTester::testRandom(int k, RandomGenerator& rng) const {
+    std::vector<BigInt> witnesses;
+    for(int i = 0; i < k; ++i) {
+	witnesses.push_back(BigInt::genRandomNum(BigInt::TWO, n - BigInt::ONE, rng));
+    }
+    return test(witnesses);
+}
+
+//x = a^d, a passes if it is +-1 or squares to -1 within s - 1 steps
+bool MillerRabinTester::finish(ModInt x) const {
+    if(x == one || x == minus_one) {
+	return true;
+    }
+    for(size_t r = 1; r < s; ++r) {
+	x = x.sqr();
+	if(x == minus_one) {
+	    return true;
+	}
+	if(x == one) {
+	    return false;
+	}
+    }
+    return false;
+}
@@ -1,11 +1,56 @@
 #include "BigInt.h"
+#include "ModInt.h"
+#include <assert.h>
 
-//TODO: Implement mod_add, mod_sub, mod_inv, mod_mul, mod_sqr
-//Should they be self assigning: i.e. mod_add : *this += add; *this %= mod instead of tmp = this; tmp += add; ...
-//Currently everything is very naive and is equivalent to just doing the operation followed by a
-//Modular reduction. This can all be improved in the future.
+//TODO: mod_mul and mod_sqr are still the operation followed by a full modular reduction.
+//mod_add and mod_sub only fall back to that when an operand is not already reduced.
+
+//mont_inv switches from the binary extended gcd to Lehmer at this many limbs
+static const size_t MONT_INV_BINARY_LIMBS = 33;
+
+//x in [0, mod) for a positive mod
+static bool isReduced(const BigInt& x, const BigInt& mod) {
+    return !x.negative && !mod.negative && x < mod;
+}
+
+/*
+* The *Reduced methods work in place on *this and operands already in [0, mod), where a sum needs
+* at most one subtraction of mod and a difference at most one addition, so there is no division.
+*/
+BigInt& BigInt::addReduced(const BigInt& add, const BigInt& mod) {
+    addMagnitude(add);
+    if(*this >= mod) {
+	subMagnitude(mod);
+    }
+    return *this;
+}
+
+BigInt& BigInt::subReduced(const BigInt& sub, const BigInt& mod) {
+    if(*this < sub) {
+	addMagnitude(mod);
+    }
+    subMagnitude(sub);
+    return *this;
+}
+
+BigInt& BigInt::negReduced(const BigInt& mod) {
+    if(!this->isZero()) {
+	//*this - mod is negative, leaving mod - *this with the sign flipped
+	subMagnitude(mod);
+	this->negative = false;
+    }
+    return *this;
+}
+
+BigInt& BigInt::doubleReduced(const BigInt& mod) {
+    return addReduced(*this, mod);
+}
 
 BigInt BigInt::mod_add(const BigInt& add, const BigInt& mod) const {
+    if(isReduced(*this, mod) && isReduced(add, mod)) {
+	BigInt tmp(*this, mod.size() + 1);
+	return std::move(tmp.addReduced(add, mod));
+    }
     BigInt tmp(*this);
     tmp += add;
     tmp %= mod;
@@ -13,11 +58,124 @@ BigInt BigInt::mod_add(const BigInt& add, const BigInt& mod) const {
 }
 
 BigInt BigInt::mod_sub(const BigInt& sub, const BigInt& mod) const { 
+    if(isReduced(*this, mod) && isReduced(sub, mod)) {
+	BigInt tmp(*this, mod.size() + 1);
+	return std::move(tmp.subReduced(sub, mod));
+    }
     BigInt tmp(*this);
     tmp -= sub;
     tmp %= mod;
     return tmp;
 }
+
+BigInt BigInt::mod_neg(const BigInt& mod) const {
+    BigInt tmp(*this);
+    if(!isReduced(tmp, mod)) {
+	tmp %= mod;
+    }
+    return std::move(tmp.negReduced(mod));
+}
+
+BigInt BigInt::mod_double(const BigInt& mod) const {
+    BigInt tmp(*this, mod.size() + 1);
+    if(!isReduced(tmp, mod)) {
+	tmp %= mod;
+    }
+    return std::move(tmp.doubleReduced(mod));
+}
+
+//hi = |x| >> k and |x| is cut to its low k bits, false if nothing was above 2^k
+static bool splitAt(BigInt& x, size_t k, BigInt& hi) {
+    const size_t q = k / x.bits;
+    const int r = k % x.bits;
+    const limb_t mask = (static_cast<limb_t>(1) << x.bits) - 1;
+    size_t n = x.size();
+    while(n > 1 && x.limbs[n - 1] == 0) {
+	--n;
+    }
+    if(n <= q || (n == q + 1 && (x.limbs[q] >> r) == 0)) {
+	return false;
+    }
+    hi.limbs.assign(n - q, 0);
+    for(size_t i = q; i < n; ++i) {
+	limb_t v = x.limbs[i] >> r;
+	if(i + 1 < n) {
+	    v |= (x.limbs[i + 1] << (x.bits - r)) & mask;
+	}
+	hi.limbs[i - q] = v;
+    }
+    x.limbs.resize(q + 1);
+    x.limbs[q] &= (static_cast<limb_t>(1) << r) - 1;
+    return true;
+}
+
+/*
+* Moduli next to a power of two, 2^k, 2^k - c and 2^k + c for 0 < c < 2^31, reduce without dividing. With
+* x = lo + 2^k hi, x is congruent to lo, lo + c hi and lo - c hi respectively, and each pass of folding hi
+* back in removes about k - 31 bits. For *this >= 0, returns false and leaves *this alone for other moduli.
+*/
+bool BigInt::reduceSpecialForm(const BigInt& mod) {
+    size_t n = mod.size();
+    while(n > 1 && mod.limbs[n - 1] == 0) {
+	--n;
+    }
+    if(n < 3 || mod.negative) {
+	return false;
+    }
+    const limb_t mask = base - 1;
+    const limb_t top = mod.limbs[n - 1];
+    const int top_bits = log2(top) + 1;
+    bool ones = top == (static_cast<limb_t>(1) << top_bits) - 1 && mod.limbs[0] != 0;
+    bool power = top == static_cast<limb_t>(1) << (top_bits - 1);
+    for(size_t i = n - 2; i > 0 && (ones || power); --i) {
+	ones &= mod.limbs[i] == mask;
+	power &= mod.limbs[i] == 0;
+    }
+    if(!ones && !power) {
+	return false;
+    }
+    const size_t k = (n - 1) * bits + top_bits - (power ? 1 : 0);
+
+    BigInt hi;
+    if(ones) {
+	//2^k - c
+	const limb_t c = base - mod.limbs[0];
+	while(splitAt(*this, k, hi)) {
+	    this->limbs.resize(std::max(this->size(), hi.size()) + 2, 0);
+	    limb_t carry = addmul_1(this->limbs.data(), hi.limbs.data(), hi.size(), c);
+	    for(size_t i = hi.size(); carry; ++i) {
+		limb_t t = this->limbs[i] + carry;
+		this->limbs[i] = t & mask;
+		carry = t >> bits;
+	    }
+	}
+	//Now below 2^k = mod + c
+	if(*this >= mod) {
+	    subMagnitude(mod);
+	}
+    } else if(mod.limbs[0] == 0) {
+	//2^k, only the mask is left to do
+	splitAt(*this, k, hi);
+    } else {
+	//2^k + c, the sign of hi follows *this as lo - c hi goes negative
+	while(splitAt(*this, k, hi)) {
+	    hi.negative = this->negative;
+	    submul_1(hi, mod.limbs[0]);
+	}
+	//Now |*this| < 2^k < mod
+	if(this->negative && !this->isZero()) {
+	    *this += mod;
+	}
+    }
+    while(this->size() > 1 && this->limbs.back() == 0) {
+	this->limbs.pop_back();
+    }
+    if(this->isZero()) {
+	this->negative = false;
+    }
+    return true;
+}
+
 BigInt BigInt::mod_mul(const BigInt& mul, const BigInt& mod) const {
     BigInt tmp(*this);
     tmp *= mul;
@@ -27,31 +185,210 @@ BigInt BigInt::mod_mul(const BigInt& mul, const BigInt& mod) const {
 
 /*
 * Will return the modular inverse a^-1 of a mod m if gcd(a, m) == 1, otherwise will return BigInt::ZERO
-* Slightly modified version of the extended euclidean algorithm since we don't care what the multiplier
-* on the modulus is.
+* Uses Lehmer's extended euclidean algorithm, see BigIntGcd.cpp
 */
 BigInt BigInt::mod_inv(const BigInt& mod) const { 
-    BigInt t = BigInt::ZERO, newt = BigInt::ONE;
-    BigInt r = mod, newr = *this;
+    BigInt m(mod);
+    m.negative = false;
+    while(m.size() > 1 && m.limbs.back() == 0) {
+	m.limbs.pop_back();
+    }
+    BigInt x(*this);
+    x.negative = false;
+    x %= m;
+    if(this->negative) {
+	x.negReduced(m);
+    }
 
-    while(newr != BigInt::ZERO) {
-	BigInt quotient = r / newr;
-	BigInt tmp = t;
-	t = newt;
-	newt = tmp - (quotient * newt);
+    return lehmerInverse(x, m);
+}
 
-	tmp = r;
-	r = newr;
-	newr = (tmp - quotient * newr);	
+/*
+* For odd m and a in Montgomery form, aR mod m with R = 2^(bits * m.size()), returns a^-1 R mod m,
+* otherwise BigInt::ZERO. Starting the binary extended gcd from R^2 instead of 1 makes the conversion free,
+* which up to ~1000 bit moduli beats inverting with Lehmer and converting with a multiplication.
+*/
+BigInt BigInt::mont_inv(const BigInt& mod) const {
+    if(!mod.isOdd()) {
+	return BigInt::ZERO;
+    }
+    BigInt m(mod);
+    m.negative = false;
+    while(m.size() > 1 && m.limbs.back() == 0) {
+	m.limbs.pop_back();
+    }
+    BigInt x(*this);
+    x.negative = false;
+    x %= m;
+    if(this->negative) {
+	x.negReduced(m);
     }
 
-    if(r > BigInt::ONE) {
-	return BigInt::ZERO;
+    BigInt r2 = BigInt::ONE;
+    r2.lLimbShift(2 * m.size());
+    r2 %= m;
+    if(m.size() <= MONT_INV_BINARY_LIMBS) {
+	return binaryInverse(x, m, r2);
+    }
+    BigInt inv = lehmerInverse(x, m);
+    if(inv.isZero()) {
+	return inv;
+    }
+    return inv.mod_mul(r2, m);
+}
+
+//-mod^-1 mod 2^bits for odd mod by Newton iteration, each step doubles the number of correct bits
+limb_t BigInt::montInverse(const BigInt& mod) {
+    limb_t inv = mod.limbs[0];
+    for(int i = 0; i < 5; ++i) {
+	inv *= 2 - mod.limbs[0] * inv;
+    }
+    return (0 - inv) & (mod.base - 1);
+}
+
+/*
+* out = a * b / R mod mod for odd mod and a, b < mod, inv = montInverse(mod). Each row of the schoolbook
+* product is reduced as it is added (CIOS), with a_i * b_j + q * m_j + t_j + carry staying below 2^63.
+* out always has mod.size() limbs and the running time only depends on the sizes of a, b and mod.
+*/
+void BigInt::montMul(const std::vector<limb_t>& a, const std::vector<limb_t>& b, const BigInt& mod, limb_t inv,
+	std::vector<limb_t>& out) {
+    BIGINT_STATS_SCOPE(MONT_MUL, mod.size());
+    const size_t n = mod.size();
+    const limb_t mask = mod.base - 1;
+    const int bits = mod.bits;
+    out.assign(n + 1, 0);
+
+    //Limbs of a and b past their size are zero
+    const size_t b_size = std::min(b.size(), n);
+    for(size_t i = 0; i < n; ++i) {
+	limb_t a_i = i < a.size() ? a[i] : 0;
+	limb_t b_0 = b_size > 0 ? b[0] : 0;
+	limb_t q = (((out[0] + a_i * b_0) & mask) * inv) & mask;
+	limb_t s = out[0] + a_i * b_0 + q * mod.limbs[0];
+	limb_t carry = s >> bits;
+	size_t j = 1;
+	for(; j < b_size; ++j) {
+	    s = out[j] + a_i * b[j] + q * mod.limbs[j] + carry;
+	    out[j - 1] = s & mask;
+	    carry = s >> bits;
+	}
+	for(; j < n; ++j) {
+	    s = out[j] + q * mod.limbs[j] + carry;
+	    out[j - 1] = s & mask;
+	    carry = s >> bits;
+	}
+	s = out[n] + carry;
+	out[n - 1] = s & mask;
+	out[n] = s >> bits;
+    }
+
+    //The result is below 2 * mod, subtract mod unless that borrows. The first pass only finds the borrow,
+    //the second subtracts mod masked to zero when it would, so there is no branch and nothing to allocate
+    long long borrow = 0;
+    for(size_t i = 0; i < n; ++i) {
+	long long t = static_cast<long long>(out[i]) - static_cast<long long>(mod.limbs[i]) + borrow;
+	borrow = t >> bits;
     }
-    if(t < BigInt::ZERO) {
-	t += mod;
+    borrow += static_cast<long long>(out[n]);
+    const limb_t take = ~static_cast<limb_t>(borrow >> 1);
+    borrow = 0;
+    for(size_t i = 0; i < n; ++i) {
+	long long t = static_cast<long long>(out[i]) - static_cast<long long>(mod.limbs[i] & take) + borrow;
+	out[i] = t & mask;
+	borrow = t >> bits;
     }
-    return t;
+    out.resize(n);
+}
+
+/*
+* Replaces every element of xs with its inverse mod m using Montgomery's trick: the prefix products are
+* inverted once and the individual inverses recovered walking back, 3(n-1) multiplications and a single
+* mod_inv in total. Elements without an inverse are set to BigInt::ZERO and their positions returned.
+*
+* For odd m the multiplications are Montgomery products. The prefix products then carry a factor R^-j,
+* which the walk back cancels exactly, so no conversions are needed.
+*/
+std::vector<size_t> BigInt::batchModInv(std::vector<BigInt>& xs, const BigInt& mod) {
+    BIGINT_STATS_SCOPE(INV_BATCH, xs.size() * mod.size());
+    BigInt m(mod);
+    m.negative = false;
+    while(m.size() > 1 && m.limbs.back() == 0) {
+	m.limbs.pop_back();
+    }
+    std::vector<size_t> bad;
+    std::vector<size_t> good;
+
+    for(size_t i = 0; i < xs.size(); ++i) {
+	bool negative = xs[i].negative;
+	xs[i].negative = false;
+	xs[i] %= m;
+	if(negative && !xs[i].isZero()) {
+	    xs[i] = m - std::move(xs[i]);
+	}
+
+	if(xs[i].isZero()) {
+	    bad.push_back(i);
+	    xs[i] = BigInt::ZERO;
+	} else {
+	    good.push_back(i);
+	}
+    }
+    if(good.empty()) {
+	return bad;
+    }
+
+    bool odd = m.isOdd();
+    limb_t inv_m = odd ? montInverse(m) : 0;
+    auto mul = [&](const BigInt& a, const BigInt& b) {
+	if(!odd) {
+	    return a.mod_mul(b, m);
+	}
+	BigInt tmp;
+	montMul(a.limbs, b.limbs, m, inv_m, tmp.limbs);
+	while(tmp.size() > 1 && tmp.limbs.back() == 0) {
+	    tmp.limbs.pop_back();
+	}
+	return tmp;
+    };
+
+    std::vector<BigInt> prefix(good.size());
+    prefix[0] = xs[good[0]];
+    for(size_t j = 1; j < good.size(); ++j) {
+	prefix[j] = mul(prefix[j-1], xs[good[j]]);
+    }
+
+    BigInt inv = prefix.back().mod_inv(m);
+    if(inv.isZero()) {
+	//Some element shares a factor with the modulus, find them all and retry without them
+	std::vector<BigInt> rest;
+	std::vector<size_t> rest_index;
+	for(auto i : good) {
+	    if(xs[i].gcd(m) == BigInt::ONE) {
+		rest.push_back(xs[i]);
+		rest_index.push_back(i);
+	    } else {
+		bad.push_back(i);
+		xs[i] = BigInt::ZERO;
+	    }
+	}
+	batchModInv(rest, m);
+	for(size_t j = 0; j < rest.size(); ++j) {
+	    xs[rest_index[j]].swap(rest[j]);
+	}
+	std::sort(bad.begin(), bad.end());
+	return bad;
+    }
+
+    //inv = (x_0 * ... * x_j)^-1, so x_j^-1 = inv * prefix[j-1]
+    for(size_t j = good.size() - 1; j > 0; --j) {
+	BigInt x_inv = mul(inv, prefix[j-1]);
+	inv = mul(inv, xs[good[j]]);
+	xs[good[j]].swap(x_inv);
+    }
+    xs[good[0]].swap(inv);
+
+    return bad;
 }
 
 BigInt BigInt::mod_sqr(const BigInt& mod) const { 
@@ -71,7 +408,7 @@ BigInt BigInt::pow(const BigInt& exp, const BigInt& mod) const {
 	//find inverse, if it exists, and I feel motivated to implement it
     } else {
 	BigInt base(*this);
-	BigInt log = log2(exp);
+	size_t log = exp.bitLength() - 1;
 	if(log >= 2048) {
 	    return BigInt::modexp_sliding_window(base, exp, mod, 7);	
 	} else if(log >= 1024) {
@@ -87,11 +424,288 @@ BigInt BigInt::pow(const BigInt& exp, const BigInt& mod) const {
 }
 
 
+/*
+* Opt-in exponentiation whose sequence of operations only depends on the sizes of exp and mod, at the cost
+* of being somewhat slower than pow(exp, mod). Only odd moduli get constant-time reductions, as those
+* are done in Montgomery form; even moduli still go through mod_mul.
+*/
+BigInt BigInt::pow_ct(const BigInt& exp, const BigInt& mod) const {
+    if(exp < BigInt::ZERO) {
+	return BigInt::ZERO;
+    }
+    BigInt m(mod);
+    m.negative = false;
+    while(m.size() > 1 && m.limbs.back() == 0) {
+	m.limbs.pop_back();
+    }
+    BigInt base(*this);
+    base.negative = false;
+    base %= m;
+    if(this->negative && !base.isZero()) {
+	base = m - std::move(base);
+    }
+
+    int k = (m.size() * m.bits > 1024) ? 5 : 4;
+    return BigInt::modexp_fixed_window(base, exp, m, k);
+}
+
+/*
+* 2^exp mod mod, left to right. Multiplying by the base is a doubling, a shift and at most one subtraction
+* of mod, so only the squarings cost a modular product, done in a ModRing (Montgomery form for odd mod).
+*/
+BigInt BigInt::pow2mod(const BigInt& exp, const BigInt& mod) {
+    BIGINT_STATS_SCOPE(MODEXP_POW2, mod.size());
+    if(exp < BigInt::ZERO) {
+	return BigInt::ZERO;
+    }
+    ModRing ring(mod);
+    ModInt x = ring.one();
+    for(size_t i = exp.bitLength(); i-- > 0; ) {
+	x = x.sqr();
+	if(exp.testBit(i)) {
+	    x += x;
+	}
+    }
+    return x.value();
+}
+
+/*
+* Fixed-window exponentiation of many bases at once. Odd moduli with the same number of limbs are dealt
+* out across the lanes of the active kernel, limb j of lane l at j * lanes + l, so one vertical Montgomery
+* product advances every lane. All lanes take the same windows of their own exponents in step and read
+* their table entries with a masked scan, as in modexp_fixed_window. Even moduli go through pow_ct.
+*/
+std::vector<BigInt> BigInt::powBatch(const std::vector<BigInt>& bases, const std::vector<BigInt>& exps, const BigInt& mod) {
+    return powBatch(bases, exps, std::vector<BigInt>(bases.size(), mod));
+}
+
+std::vector<BigInt> BigInt::powBatch(const std::vector<BigInt>& bases, const std::vector<BigInt>& exps,
+	const std::vector<BigInt>& mods) {
+    BIGINT_STATS_SCOPE(MODEXP_BATCH, mods.empty() ? 0 : mods[0].size());
+    assert(bases.size() == exps.size() && bases.size() == mods.size());
+    const MulKernel kernel = mulKernel();
+    const size_t lanes = montLanes(kernel);
+    std::vector<BigInt> results(bases.size());
+
+    std::vector<size_t> order;
+    for(size_t i = 0; i < bases.size(); ++i) {
+	if(exps[i] < BigInt::ZERO) {
+	    results[i] = BigInt::ZERO;
+	} else if(!mods[i].isOdd()) {
+	    results[i] = bases[i].pow_ct(exps[i], mods[i]);
+	} else {
+	    order.push_back(i);
+	}
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) { return mods[x].size() < mods[y].size(); });
+
+    for(size_t first = 0; first < order.size(); ) {
+	size_t last = first + 1;
+	while(last < order.size() && last - first < lanes && mods[order[last]].size() == mods[order[first]].size()) {
+	    ++last;
+	}
+	powLanes(bases, exps, mods, order.data() + first, last - first, kernel, results);
+	first = last;
+    }
+    return results;
+}
+
+//Lanes past count repeat the first operand, so every lane has a modulus, and their results are dropped
+void BigInt::powLanes(const std::vector<BigInt>& bases, const std::vector<BigInt>& exps, const std::vector<BigInt>& mods,
+	const size_t * idx, size_t count, MulKernel kernel, std::vector<BigInt>& results) {
+    const size_t lanes = montLanes(kernel);
+    const size_t n = mods[idx[0]].size();
+    const size_t width = (n + 1) * lanes;
+
+    std::vector<BigInt> m(lanes);
+    std::vector<limb_t> mod(width, 0), inv(lanes);
+    size_t bits = 0;
+    for(size_t l = 0; l < lanes; ++l) {
+	size_t i = idx[l < count ? l : 0];
+	m[l] = mods[i];
+	m[l].negative = false;
+	inv[l] = montInverse(m[l]);
+	for(size_t j = 0; j < n; ++j) {
+	    mod[j * lanes + l] = m[l].limbs[j];
+	}
+	bits = std::max(bits, exps[i].bitLength());
+    }
+
+    const int k = bits > 1024 ? 5 : 4;
+    const size_t entries = static_cast<size_t>(1) << k;
+    std::vector<std::vector<limb_t>> table(entries, std::vector<limb_t>(width, 0));
+
+    //R mod m and base R mod m, converted one lane at a time
+    std::vector<limb_t> one(1, 1), out;
+    for(size_t l = 0; l < lanes; ++l) {
+	const BigInt& base = bases[idx[l < count ? l : 0]];
+	BigInt r2 = BigInt::ONE;
+	r2.lLimbShift(2 * n);
+	r2 %= m[l];
+	BigInt x(base);
+	x.negative = false;
+	x %= m[l];
+	if(base.negative && !x.isZero()) {
+	    x = m[l] - std::move(x);
+	}
+	montMul(one, r2.limbs, m[l], inv[l], out);
+	for(size_t j = 0; j < n; ++j) {
+	    table[0][j * lanes + l] = out[j];
+	}
+	montMul(x.limbs, r2.limbs, m[l], inv[l], out);
+	for(size_t j = 0; j < n; ++j) {
+	    table[1][j * lanes + l] = out[j];
+	}
+    }
+    for(size_t e = 2; e < entries; ++e) {
+	montMulLanes(kernel, table[e - 1].data(), table[1].data(), mod.data(), inv.data(), n, table[e].data());
+    }
+
+    std::vector<limb_t> acc(table[0]), selected(width), tmp(width);
+    std::vector<limb_t> index(lanes);
+    const size_t windows = (bits + k - 1) / k;
+    for(size_t w = windows; w-- > 0; ) {
+	for(size_t l = 0; l < lanes; ++l) {
+	    const BigInt& exp = exps[idx[l < count ? l : 0]];
+	    index[l] = 0;
+	    for(int b = k - 1; b >= 0; --b) {
+		index[l] = (index[l] << 1) | exp.testBit(w * k + b);
+	    }
+	}
+	std::fill(selected.begin(), selected.end(), 0);
+	for(size_t e = 0; e < entries; ++e) {
+	    for(size_t j = 0; j < n; ++j) {
+		for(size_t l = 0; l < lanes; ++l) {
+		    selected[j * lanes + l] |= table[e][j * lanes + l] & (0 - static_cast<limb_t>(index[l] == e));
+		}
+	    }
+	}
+
+	//The accumulator starts out as the top window's entry, later windows square k times first
+	if(w + 1 == windows) {
+	    acc.swap(selected);
+	    continue;
+	}
+	for(int i = 0; i < k; ++i) {
+	    montMulLanes(kernel, acc.data(), acc.data(), mod.data(), inv.data(), n, tmp.data());
+	    acc.swap(tmp);
+	}
+	montMulLanes(kernel, acc.data(), selected.data(), mod.data(), inv.data(), n, tmp.data());
+	acc.swap(tmp);
+    }
+
+    std::vector<limb_t> lane(n);
+    for(size_t l = 0; l < count; ++l) {
+	for(size_t j = 0; j < n; ++j) {
+	    lane[j] = acc[j * lanes + l];
+	}
+	BigInt r;
+	montMul(lane, one, m[l], inv[l], r.limbs);
+	while(r.size() > 1 && r.limbs.back() == 0) {
+	    r.limbs.pop_back();
+	}
+	results[idx[l]] = std::move(r);
+    }
+}
+
+/**
+* Fixed-window (m-ary) exponentiation: every window of k bits costs k squarings and one multiplication,
+* including windows of zeros, and the exponent is padded to at least the length of the modulus. The
+* table entry for each window is read with a full scan of the table under a mask, so neither the
+* sequence of operations nor the memory access pattern depends on the bits of exp.
+*/
+BigInt BigInt::modexp_fixed_window(const BigInt& base, const BigInt& exp, const BigInt& mod, int k) {
+    BIGINT_STATS_SCOPE(MODEXP_FIXED, mod.size());
+    const size_t n = mod.size();
+    const size_t entries = static_cast<size_t>(1) << k;
+    const bool odd = mod.isOdd();
+    const limb_t inv = odd ? montInverse(mod) : 0;
+
+    std::vector<std::vector<limb_t>> table(entries);
+    auto mul = [&](const std::vector<limb_t>& a, const std::vector<limb_t>& b, std::vector<limb_t>& out) {
+	if(odd) {
+	    montMul(a, b, mod, inv, out);
+	    return;
+	}
+	//The table and accumulator are padded to n limbs, the multiplication wants them trimmed
+	BigInt x, y;
+	x.limbs = a;
+	y.limbs = b;
+	while(x.size() > 1 && x.limbs.back() == 0) {
+	    x.limbs.pop_back();
+	}
+	while(y.size() > 1 && y.limbs.back() == 0) {
+	    y.limbs.pop_back();
+	}
+	x = x.mod_mul(y, mod);
+	out.swap(x.limbs);
+	out.resize(n, 0);
+    };
+
+    //The table holds base^i, in Montgomery form for odd moduli
+    std::vector<limb_t> one(1, 1);
+    if(odd) {
+	BigInt r2 = BigInt::ONE;
+	r2.lLimbShift(2 * n);
+	r2 %= mod;
+	mul(one, r2.limbs, table[0]);
+	mul(base.limbs, r2.limbs, table[1]);
+    } else {
+	table[0] = one;
+	table[0].resize(n, 0);
+	table[1] = base.limbs;
+	table[1].resize(n, 0);
+    }
+    for(size_t i = 2; i < entries; ++i) {
+	mul(table[i-1], table[1], table[i]);
+    }
+
+    size_t windows = (std::max(exp.bitLength(), n * mod.bits) + k - 1) / k;
+
+    std::vector<limb_t> result(table[0]), selected(n), tmp;
+    for(size_t w = windows; w-- > 0; ) {
+	for(int i = 0; i < k; ++i) {
+	    mul(result, result, tmp);
+	    result.swap(tmp);
+	}
+
+	limb_t index = 0;
+	for(int i = k - 1; i >= 0; --i) {
+	    size_t bit = w * k + i;
+	    size_t limb = bit / exp.bits;
+	    limb_t b = limb < exp.size() ? (exp.limbs[limb] >> (bit % exp.bits)) & 1 : 0;
+	    index = (index << 1) | b;
+	}
+
+	std::fill(selected.begin(), selected.end(), 0);
+	for(size_t e = 0; e < entries; ++e) {
+	    limb_t take = 0 - static_cast<limb_t>(e == index);
+	    for(size_t l = 0; l < n; ++l) {
+		selected[l] |= table[e][l] & take;
+	    }
+	}
+	mul(result, selected, tmp);
+	result.swap(tmp);
+    }
+
+    if(odd) {
+	mul(result, one, tmp);
+	result.swap(tmp);
+    }
+    BigInt ret;
+    ret.limbs.swap(result);
+    while(ret.size() > 1 && ret.limbs.back() == 0) {
+	ret.limbs.pop_back();
+    }
+    return ret;
+}
+
 /**
 * Partitions the exponent into variable-length zero words, and constant length non-zero words to minimize 
 * the number of multiplications required compared to an m-ary multiplication.
 */
 BigInt BigInt::modexp_sliding_window(const BigInt& base, const BigInt& exp, const BigInt& mod, int k) {
+    BIGINT_STATS_SCOPE(MODEXP_SLIDING, mod.size());
 
     limb_t m = 1 << k;
 
@@ -106,58 +720,44 @@ BigInt BigInt::modexp_sliding_window(const BigInt& base, const BigInt& exp, cons
     }
 
 
-    std::vector<std::string> windows;
-
-    {
-        std::string bits = exp.ToBinary();
-        auto window_it = bits.rbegin();
-        for(; window_it + k < bits.rend(); ) {
-            if(*window_it == '1') {
-                std::string window(window_it, window_it + k);
-                std::reverse(window.begin(), window.end());
-                windows.push_back(window);
-                window_it += k;
-            } else {
-                int i = 0;
-                while(*(window_it + i) == '0') {
-                    ++i;
-                }
-                windows.push_back(std::string(window_it, window_it + i));	    
-                window_it += i;
-            }
-        }    
-        if(window_it < bits.rend()) {
-            std::string window(window_it, bits.rend());
-            window.resize(k, 0);
-            std::reverse(window.begin(), window.end());
-            windows.push_back(window);
-        }
-    }
-    
+    //Scan the exponent from the msb, each run of zeros costs only squarings while each
+    //window of at most k bits starting and ending with a 1 costs one multiplication
+    std::string bits = exp.ToBinary();
+    size_t i = bits.find_first_of('1');
+
     BigInt result = BigInt::ONE;
-    
-    limb_t index = std::strtoll(windows.rbegin()->c_str(), nullptr,2);
-    if(index) {
-        result = xs[index/2];
-    }
+    bool first = true;
 
-    //The windows are stored starting from the lsb of the exponential, start from
-    //the top and work down
-    for(auto it = windows.rbegin() + 1; it < windows.rend(); ++it) {
-        for(int i = 0; i < it->length(); ++i) {
+    while(i < bits.size()) {
+        if(bits[i] == '0') {
             result = result.mod_sqr(mod);
+            ++i;
+            continue;
         }
 
-        limb_t index = std::strtoll(it->c_str(), nullptr, 2);
-        if(index) {
+        size_t j = std::min(i + k, bits.size()) - 1;
+        while(bits[j] == '0') {
+            --j;
+        }
+
+        limb_t index = std::strtoll(bits.substr(i, j - i + 1).c_str(), nullptr, 2);
+        if(first) {
+            result = xs[index>>1];
+            first = false;
+        } else {
+            for(size_t l = i; l <= j; ++l) {
+                result = result.mod_sqr(mod);
+            }
             result = result.mod_mul(xs[index>>1], mod);
         }
+        i = j + 1;
     }
 
     return result;
 }
 
 BigInt BigInt::modexp_montgomery(const BigInt& base, const BigInt& exp, const BigInt& mod) {
+    BIGINT_STATS_SCOPE(MODEXP_LADDER, mod.size());
     
     BigInt t1(base % mod);
     BigInt t2((t1 * t1) % mod);
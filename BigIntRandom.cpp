@@ -0,0 +1,216 @@
+#include "BigInt.h"
+
+/**
+ * Random generation
+ *
+ * RandomGenerator is the ChaCha20 block function run in counter mode, each block giving 16 words of
+ * keystream. Every thread gets its own generator, seeded from std::random_device on first use, so the
+ * static generators need no locking; seeding one explicitly makes a run reproducible.
+ */
+
+static inline uint32_t rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline void quarterRound(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+    a += b; d ^= a; d = rotl(d, 16);
+    c += d; b ^= c; b = rotl(b, 12);
+    a += b; d ^= a; d = rotl(d, 8);
+    c += d; b ^= c; b = rotl(b, 7);
+}
+
+RandomGenerator::RandomGenerator() {
+    std::random_device device;
+    uint32_t key[8];
+    for(auto& k : key) {
+        k = device();
+    }
+    setKey(key);
+}
+
+RandomGenerator::RandomGenerator(unsigned long long seed) {
+    this->seed(seed);
+}
+
+RandomGenerator::RandomGenerator(const uint32_t key[8], unsigned long long nonce, unsigned long long counter) {
+    setKey(key);
+    state[12] = static_cast<uint32_t>(counter);
+    state[13] = static_cast<uint32_t>(counter >> 32);
+    state[14] = static_cast<uint32_t>(nonce);
+    state[15] = static_cast<uint32_t>(nonce >> 32);
+}
+
+//The key is the seed expanded with splitmix64
+void RandomGenerator::seed(unsigned long long seed) {
+    uint32_t key[8];
+    for(int i = 0; i < 4; ++i) {
+        seed += 0x9E3779B97F4A7C15ULL;
+        unsigned long long z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        key[2 * i] = static_cast<uint32_t>(z);
+        key[2 * i + 1] = static_cast<uint32_t>(z >> 32);
+    }
+    setKey(key);
+}
+
+void RandomGenerator::setKey(const uint32_t key[8]) {
+    //"expand 32-byte k"
+    state[0] = 0x61707865;
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    for(int i = 0; i < 8; ++i) {
+        state[4 + i] = key[i];
+    }
+    //64 bit block counter and a zero nonce
+    for(int i = 12; i < 16; ++i) {
+        state[i] = 0;
+    }
+    used = block.size();
+}
+
+void RandomGenerator::refill() {
+    block = state;
+    for(int i = 0; i < 10; ++i) {
+        quarterRound(block[0], block[4], block[8], block[12]);
+        quarterRound(block[1], block[5], block[9], block[13]);
+        quarterRound(block[2], block[6], block[10], block[14]);
+        quarterRound(block[3], block[7], block[11], block[15]);
+        quarterRound(block[0], block[5], block[10], block[15]);
+        quarterRound(block[1], block[6], block[11], block[12]);
+        quarterRound(block[2], block[7], block[8], block[13]);
+        quarterRound(block[3], block[4], block[9], block[14]);
+    }
+    for(size_t i = 0; i < block.size(); ++i) {
+        block[i] += state[i];
+    }
+    if(++state[12] == 0) {
+        ++state[13];
+    }
+    used = 0;
+}
+
+uint32_t RandomGenerator::next() {
+    if(used == block.size()) {
+        refill();
+    }
+    return block[used++];
+}
+
+//n limbs of bits random bits each, copied out of the keystream a block at a time
+void RandomGenerator::fill(limb_t * out, size_t n, int bits) {
+    const uint32_t mask = static_cast<uint32_t>((static_cast<limb_t>(1) << bits) - 1);
+    while(n > 0) {
+        if(used == block.size()) {
+            refill();
+        }
+        size_t take = std::min(n, block.size() - used);
+        for(size_t i = 0; i < take; ++i) {
+            out[i] = block[used + i] & mask;
+        }
+        used += take;
+        out += take;
+        n -= take;
+    }
+}
+
+RandomGenerator& BigInt::threadRandom() {
+    static thread_local RandomGenerator generator;
+    return generator;
+}
+
+BigInt BigInt::genRandomBits(size_t bits){
+    return genRandomBits(bits, threadRandom());
+}
+
+BigInt BigInt::genRandomBits(size_t bits, RandomGenerator& rng){
+    BigInt result;    
+    size_t n = (bits + result.bits - 1) / result.bits;
+    BIGINT_STATS_SCOPE(RANDOM_BITS, n);
+    if(n == 0) {
+        result.limbs.push_back(0);
+        return result;
+    }
+
+    result.limbs.resize(n);
+    rng.fill(result.limbs.data(), n, result.bits);
+    int bits_left = bits % result.bits;
+    if(bits_left != 0){
+        result.limbs.back() &= (static_cast<limb_t>(1) << bits_left) - 1;
+    }
+
+    while(result.size() > 1 && result.limbs.back() == 0) {
+        result.limbs.pop_back();
+    }
+    return result;
+}
+
+BigInt BigInt::genRandomBits(const BigInt& bits){
+    limb_t n = 0;
+    for(int i = bits.size() -1; i >= 0; --i) {
+        n = (n << bits.bits) | bits.limbs[i];
+    }
+    return genRandomBits(static_cast<size_t>(n));
+}
+
+BigInt BigInt::genRandomNum(const BigInt& high) {
+    return genRandomNum(high, threadRandom());
+}
+
+/*
+ * Uniform in [0, high). Limbs are drawn from the top down and compared against high as they go, so a
+ * candidate that is already too large is rejected after its first differing limb rather than after
+ * generating all of it. As the top limb is masked to the bit length of high each attempt succeeds with
+ * probability at least 1/2.
+ */
+BigInt BigInt::genRandomNum(const BigInt& high, RandomGenerator& rng) {
+    BigInt result;
+    if(high <= BigInt::ZERO) {
+        result.limbs.push_back(0);
+        return result;
+    }
+
+    size_t bits = high.bitLength();
+    size_t n = (bits + result.bits - 1) / result.bits;
+    const limb_t top_mask = (static_cast<limb_t>(1) << (bits - (n - 1) * result.bits)) - 1;
+    const limb_t mask = result.base - 1;
+    result.limbs.resize(n);
+
+    while(true) {
+        //Limbs below i are still to be drawn, above are equal to those of high
+        size_t i = n;
+        bool below = false;
+        while(i-- > 0) {
+            limb_t limb = rng.next() & (i == n - 1 ? top_mask : mask);
+            result.limbs[i] = limb;
+            if(limb != high.limbs[i]) {
+                below = limb < high.limbs[i];
+                break;
+            }
+        }
+        if(!below) {
+            continue;
+        }
+        rng.fill(result.limbs.data(), i, result.bits);
+        break;
+    }
+
+    while(result.size() > 1 && result.limbs.back() == 0) {
+        result.limbs.pop_back();
+    }
+    return result;
+}
+
+
+BigInt BigInt::genRandomNum(const BigInt& low, const BigInt& high) {
+    return genRandomNum(low, high, threadRandom());
+}
+
+BigInt BigInt::genRandomNum(const BigInt& low, const BigInt& high, RandomGenerator& rng) {
+    BigInt diff = high - low;
+    BigInt result = low;
+    result += genRandomNum(diff, rng);
+    return result;
+}
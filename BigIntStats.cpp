@@ -0,0 +1,128 @@
+#include "BigInt.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Instrumentation
+ *
+ * Counters are shared by all threads and updated with relaxed atomics. Each thread keeps a stack of
+ * the instrumented routines it is in (linked through the Scope objects themselves), which is what
+ * lets allocations be charged to the innermost routine and callee cycles be taken out of the caller.
+ * Cycles are read from the time stamp counter where there is one, and are nanoseconds otherwise.
+ */
+
+static const char * const op_names[BigIntStats::OP_COUNT] = {
+    "mul.schoolbook", "mul.basecase", "mul.karatsuba", "div.word", "div.knuth",
+    "conv.to_decimal", "conv.from_string", "gcd", "gcd.half", "inv.lehmer", "inv.binary", "inv.batch",
+    "mont_mul", "modexp.ladder", "modexp.sliding", "modexp.fixed", "modexp.pow2", "modexp.batch", "prime.miller_rabin",
+    "prime.lucas_lehmer", "prime.proth", "random.bits"
+};
+
+static std::atomic<unsigned long long> counters[BigIntStats::OP_COUNT][4];
+
+static thread_local BigIntStats::Scope * current = nullptr;
+
+static inline unsigned long long readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+bool BigIntStats::enabled() {
+#ifdef _BIGINT_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char * BigIntStats::name(Op op) {
+    return op < OP_COUNT ? op_names[op] : "unknown";
+}
+
+BigIntStats::Snapshot BigIntStats::snapshot() {
+    Snapshot stats;
+    for(int i = 0; i < OP_COUNT; ++i) {
+        stats[i].calls = counters[i][0].load(std::memory_order_relaxed);
+        stats[i].limbs = counters[i][1].load(std::memory_order_relaxed);
+        stats[i].allocations = counters[i][2].load(std::memory_order_relaxed);
+        stats[i].cycles = counters[i][3].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void BigIntStats::reset() {
+    for(auto& op : counters) {
+        for(auto& c : op) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void BigIntStats::dump(std::ostream& out) {
+    dump(out, snapshot());
+}
+
+void BigIntStats::dump(std::ostream& out, const Snapshot& stats) {
+    unsigned long long total = 0;
+    for(auto& s : stats) {
+        total += s.cycles;
+    }
+
+    out << std::left << std::setw(20) << "routine" << std::right << std::setw(12) << "calls" << std::setw(14) << "limbs"
+        << std::setw(12) << "allocs" << std::setw(16) << "cycles" << std::setw(12) << "cyc/call" << std::setw(8) << "%" << "\n";
+    for(int i = 0; i < OP_COUNT; ++i) {
+        const OpStats& s = stats[i];
+        if(s.calls == 0) {
+            continue;
+        }
+        out << std::left << std::setw(20) << op_names[i] << std::right << std::setw(12) << s.calls << std::setw(14) << s.limbs
+            << std::setw(12) << s.allocations << std::setw(16) << s.cycles << std::setw(12) << s.cycles / s.calls
+            << std::setw(8) << std::fixed << std::setprecision(1) << (total ? 100.0 * s.cycles / total : 0.0) << "\n";
+    }
+}
+
+BigIntStats::Scope::Scope(Op op, size_t limbs): op(op), parent(current), start(0), children(0) {
+    counters[op][0].fetch_add(1, std::memory_order_relaxed);
+    counters[op][1].fetch_add(limbs, std::memory_order_relaxed);
+    current = this;
+    start = readCycles();
+}
+
+BigIntStats::Scope::~Scope() {
+    unsigned long long elapsed = readCycles() - start;
+    counters[op][3].fetch_add(elapsed - std::min(elapsed, children), std::memory_order_relaxed);
+    if(parent != nullptr) {
+        parent->children += elapsed;
+    }
+    current = parent;
+}
+
+void BigIntStats::countAllocation() {
+    if(current != nullptr) {
+        counters[current->op][2].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#ifdef _BIGINT_STATS
+//Every other form of operator new and delete forwards to these two
+void * operator new(std::size_t size) {
+    BigIntStats::countAllocation();
+    void * p = std::malloc(size ? size : 1);
+    if(p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+#endif
@@ -0,0 +1,311 @@
+#ifndef _FixedBigInt
+#define _FixedBigInt
+#include "BigInt.h"
+#include <utility>
+
+/*
+ * Unsigned integer of a size fixed at compile time, for the few sizes (256 to 4096 bits) that hot paths
+ * work with. Limbs are the same 31 bit limbs as BigInt's, least significant first, but stored inline,
+ * so converting to and from BigInt is a copy, nothing is allocated and every loop bound is a constant
+ * the compiler can unroll. Arithmetic wraps mod 2^(31 * LIMBS), which is at least 2^Bits.
+ */
+template<size_t Bits>
+class FixedBigInt {
+    public:
+	static const int LIMB_BITS = 31;
+	static const size_t LIMBS = (Bits + LIMB_BITS - 1) / LIMB_BITS;
+	static const limb_t MASK = (static_cast<limb_t>(1) << LIMB_BITS) - 1;
+	//Holds any product of two FixedBigInt<Bits>
+	typedef FixedBigInt<2 * LIMB_BITS * LIMBS> Wide;
+
+	std::array<limb_t, LIMBS> limbs;
+
+	FixedBigInt(): limbs() {}
+
+	FixedBigInt(limb_t ull): limbs() {
+	    limbs[0] = ull & MASK;
+	    if(LIMBS > 1) {
+		limbs[1 % LIMBS] = (ull >> LIMB_BITS) & MASK;
+	    }
+	    if(LIMBS > 2) {
+		limbs[2 % LIMBS] = ull >> (2 * LIMB_BITS);
+	    }
+	}
+
+	//Takes the magnitude of n mod 2^(31 * LIMBS)
+	explicit FixedBigInt(const BigInt& n): limbs() {
+	    std::copy(n.limbs.begin(), n.limbs.begin() + std::min(n.size(), LIMBS), limbs.begin());
+	}
+
+	//Compile time constant from a _big literal, limbs past the literal are zero and past LIMBS dropped
+	template<size_t M>
+	constexpr FixedBigInt(const BigLiteral<M>& lit): FixedBigInt(lit, std::make_index_sequence<LIMBS>()) {}
+
+	BigInt toBigInt() const {
+	    BigInt n;
+	    size_t used = LIMBS;
+	    while(used > 1 && limbs[used - 1] == 0) {
+		--used;
+	    }
+	    n.limbs.assign(limbs.begin(), limbs.begin() + used);
+	    return n;
+	}
+
+	bool isZero() const {
+	    limb_t acc = 0;
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		acc |= limbs[i];
+	    }
+	    return acc == 0;
+	}
+
+	bool operator==(const FixedBigInt& rhs) const {
+	    return limbs == rhs.limbs;
+	}
+
+	bool operator!=(const FixedBigInt& rhs) const {
+	    return limbs != rhs.limbs;
+	}
+
+	bool operator<(const FixedBigInt& rhs) const {
+	    for(size_t i = LIMBS; i-- > 0;) {
+		if(limbs[i] != rhs.limbs[i]) {
+		    return limbs[i] < rhs.limbs[i];
+		}
+	    }
+	    return false;
+	}
+
+	//Returns the carry out of the top limb
+	limb_t add(const FixedBigInt& rhs) {
+	    limb_t carry = 0;
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		limb_t t = limbs[i] + rhs.limbs[i] + carry;
+		limbs[i] = t & MASK;
+		carry = t >> LIMB_BITS;
+	    }
+	    return carry;
+	}
+
+	//Returns 1 if rhs was larger and the result wrapped around
+	limb_t sub(const FixedBigInt& rhs) {
+	    limb_t borrow = 0;
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		limb_t t = limbs[i] - rhs.limbs[i] - borrow;
+		limbs[i] = t & MASK;
+		borrow = t >> 63;
+	    }
+	    return borrow;
+	}
+
+	FixedBigInt& operator+=(const FixedBigInt& rhs) {
+	    add(rhs);
+	    return *this;
+	}
+
+	FixedBigInt& operator-=(const FixedBigInt& rhs) {
+	    sub(rhs);
+	    return *this;
+	}
+
+	FixedBigInt operator+(const FixedBigInt& rhs) const {
+	    FixedBigInt tmp(*this);
+	    tmp.add(rhs);
+	    return tmp;
+	}
+
+	FixedBigInt operator-(const FixedBigInt& rhs) const {
+	    FixedBigInt tmp(*this);
+	    tmp.sub(rhs);
+	    return tmp;
+	}
+
+	//Full product, schoolbook with the carry propagated along each row
+	Wide mul(const FixedBigInt& rhs) const {
+	    Wide r;
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		limb_t carry = 0;
+		for(size_t j = 0; j < LIMBS; ++j) {
+		    limb_t t = r.limbs[i + j] + limbs[i] * rhs.limbs[j] + carry;
+		    r.limbs[i + j] = t & MASK;
+		    carry = t >> LIMB_BITS;
+		}
+		r.limbs[i + LIMBS] = carry;
+	    }
+	    return r;
+	}
+
+	//The products above the diagonal once, doubled, then the squares on the diagonal added in
+	Wide sqr() const {
+	    Wide r;
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		limb_t carry = 0;
+		for(size_t j = i + 1; j < LIMBS; ++j) {
+		    limb_t t = r.limbs[i + j] + limbs[i] * limbs[j] + carry;
+		    r.limbs[i + j] = t & MASK;
+		    carry = t >> LIMB_BITS;
+		}
+		r.limbs[i + LIMBS] = carry;
+	    }
+	    limb_t carry = 0;
+	    for(size_t i = 0; i < 2 * LIMBS; ++i) {
+		limb_t t = (r.limbs[i] << 1) + carry;
+		if(i % 2 == 0) {
+		    t += limbs[i / 2] * limbs[i / 2];
+		}
+		r.limbs[i] = t & MASK;
+		carry = t >> LIMB_BITS;
+	    }
+	    return r;
+	}
+
+	//-mod^-1 mod 2^31 for odd mod by Newton iteration
+	static limb_t montInverse(const FixedBigInt& mod) {
+	    limb_t inv = mod.limbs[0];
+	    for(int i = 0; i < 5; ++i) {
+		inv *= 2 - mod.limbs[0] * inv;
+	    }
+	    return (0 - inv) & MASK;
+	}
+
+	/*
+	 * a * b / 2^(31 * LIMBS) mod mod for odd mod and a, b < mod, the same CIOS reduction as
+	 * BigInt::montMul, ending in a masked rather than branching subtraction.
+	 */
+	static FixedBigInt montMul(const FixedBigInt& a, const FixedBigInt& b, const FixedBigInt& mod, limb_t inv) {
+	    std::array<limb_t, LIMBS + 1> t = {};
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		limb_t s = t[0] + a.limbs[i] * b.limbs[0];
+		limb_t q = ((s & MASK) * inv) & MASK;
+		s += q * mod.limbs[0];
+		limb_t carry = s >> LIMB_BITS;
+		for(size_t j = 1; j < LIMBS; ++j) {
+		    s = t[j] + a.limbs[i] * b.limbs[j] + q * mod.limbs[j] + carry;
+		    t[j - 1] = s & MASK;
+		    carry = s >> LIMB_BITS;
+		}
+		s = t[LIMBS] + carry;
+		t[LIMBS - 1] = s & MASK;
+		t[LIMBS] = s >> LIMB_BITS;
+	    }
+
+	    FixedBigInt r, diff;
+	    std::copy(t.begin(), t.begin() + LIMBS, r.limbs.begin());
+	    diff = r;
+	    limb_t borrow = diff.sub(mod);
+	    //Keep r only if subtracting mod borrowed out of all LIMBS + 1 limbs
+	    limb_t keep = 0 - (borrow & (t[LIMBS] ^ 1));
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		r.limbs[i] = (r.limbs[i] & keep) | (diff.limbs[i] & ~keep);
+	    }
+	    return r;
+	}
+
+    private:
+	template<size_t M, size_t... I>
+	constexpr FixedBigInt(const BigLiteral<M>& lit, std::index_sequence<I...>): limbs{{(I < M ? lit.limbs[I] : 0)...}} {}
+};
+
+template<size_t Bits> const int FixedBigInt<Bits>::LIMB_BITS;
+template<size_t Bits> const size_t FixedBigInt<Bits>::LIMBS;
+template<size_t Bits> const limb_t FixedBigInt<Bits>::MASK;
+
+/*
+ * Arithmetic mod a fixed odd modulus of at most 31 * LIMBS bits on FixedBigInt<Bits> in Montgomery form,
+ * R = 2^(31 * LIMBS). Setting up uses BigInt, after that nothing allocates.
+ */
+template<size_t Bits>
+class FixedMontgomery {
+    public:
+	typedef FixedBigInt<Bits> Int;
+
+	explicit FixedMontgomery(const BigInt& modulus): mod(modulus), inv(Int::montInverse(mod)),
+		r1((BigInt::ONE << (Int::LIMB_BITS * Int::LIMBS)) % modulus),
+		r2((BigInt::ONE << (2 * Int::LIMB_BITS * Int::LIMBS)) % modulus) {}
+
+	const Int& modulus() const {
+	    return mod;
+	}
+
+	//R mod m, one in Montgomery form
+	const Int& one() const {
+	    return r1;
+	}
+
+	Int toMont(const BigInt& x) const {
+	    BigInt reduced = x % mod.toBigInt();
+	    if(reduced.negative && !reduced.isZero()) {
+		reduced += mod.toBigInt();
+	    }
+	    return Int::montMul(Int(reduced), r2, mod, inv);
+	}
+
+	BigInt fromMont(const Int& x) const {
+	    return Int::montMul(x, Int(1), mod, inv).toBigInt();
+	}
+
+	Int mul(const Int& a, const Int& b) const {
+	    return Int::montMul(a, b, mod, inv);
+	}
+
+	Int sqr(const Int& a) const {
+	    return Int::montMul(a, a, mod, inv);
+	}
+
+	Int add(const Int& a, const Int& b) const {
+	    Int sum(a), diff;
+	    limb_t carry = sum.add(b);
+	    diff = sum;
+	    limb_t borrow = diff.sub(mod);
+	    //a + b < mod exactly when subtracting mod borrows and the addition did not carry
+	    return select(sum, diff, (borrow & (carry ^ 1)) ^ 1);
+	}
+
+	Int sub(const Int& a, const Int& b) const {
+	    Int diff(a), sum;
+	    limb_t borrow = diff.sub(b);
+	    sum = diff;
+	    sum.add(mod);
+	    return select(sum, diff, borrow ^ 1);
+	}
+
+	//base in Montgomery form, 4 bit fixed windows from the top of exp
+	Int pow(const Int& base, const BigInt& exp) const {
+	    Int table[16];
+	    table[0] = r1;
+	    for(int i = 1; i < 16; ++i) {
+		table[i] = mul(table[i - 1], base);
+	    }
+	    Int acc = r1;
+	    size_t windows = (exp.bitLength() + 3) / 4;
+	    for(size_t w = windows; w-- > 0;) {
+		for(int i = 0; i < 4; ++i) {
+		    acc = sqr(acc);
+		}
+		int digit = 0;
+		for(int i = 3; i >= 0; --i) {
+		    digit = (digit << 1) | exp.testBit(4 * w + i);
+		}
+		acc = mul(acc, table[digit]);
+	    }
+	    return acc;
+	}
+
+    private:
+	//a if pick_b is 0, b if it is 1
+	static Int select(const Int& a, const Int& b, limb_t pick_b) {
+	    limb_t mask = 0 - pick_b;
+	    Int r;
+	    for(size_t i = 0; i < Int::LIMBS; ++i) {
+		r.limbs[i] = (a.limbs[i] & ~mask) | (b.limbs[i] & mask);
+	    }
+	    return r;
+	}
+
+	Int mod;
+	limb_t inv;
+	Int r1;
+	Int r2;
+};
+
+#endif
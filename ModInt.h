@@ -0,0 +1,120 @@
+#ifndef _ModInt
+#define _ModInt
+#include "BigInt.h"
+
+class ModInt;
+
+/*
+ * A modulus together with everything precomputed for reducing by it. Residues of odd moduli are kept in
+ * Montgomery form, xR mod m with R = 2^(bits * m.size()), so a product is a single montMul and only
+ * converting into and out of the ring costs a division. Even moduli keep plain residues and reduce
+ * products with mod_mul. ModInts point to their ring, which has to outlive them.
+ */
+class ModRing {
+    public:
+	explicit ModRing(const BigInt& modulus);
+	ModRing(const ModRing&) = delete;
+	ModRing& operator=(const ModRing&) = delete;
+
+	const BigInt& modulus() const;
+	bool isMontgomery() const;
+
+	//x mod m as an element of the ring, x can be negative or unreduced
+	ModInt operator()(const BigInt& x) const;
+	ModInt zero() const;
+	ModInt one() const;
+
+    private:
+	friend class ModInt;
+
+	//Conversions between residues in [0, m) and their representation
+	BigInt toRep(const BigInt& x) const;
+	BigInt fromRep(const BigInt& x) const;
+	void mul(BigInt& a, const BigInt& b) const;
+
+	BigInt mod;
+	bool odd;
+	limb_t inv;
+	//R mod m and R^2 mod m
+	BigInt r1;
+	BigInt r2;
+};
+
+/*
+ * An element of a ModRing. Arithmetic stays in the ring's representation: + and - are a single
+ * conditional correction, * a Montgomery product for odd moduli, and value() converts back.
+ */
+class ModInt {
+    public:
+	ModInt();
+	ModInt(const ModRing& ring, const BigInt& x);
+
+	const ModRing& ring() const;
+	BigInt value() const;
+	bool isZero() const;
+
+	ModInt& operator+=(const ModInt& rhs);
+	ModInt& operator-=(const ModInt& rhs);
+	ModInt& operator*=(const ModInt& rhs);
+	ModInt operator+(const ModInt& rhs) const;
+	ModInt operator-(const ModInt& rhs) const;
+	ModInt operator*(const ModInt& rhs) const;
+	ModInt operator-() const;
+	bool operator==(const ModInt& rhs) const;
+	bool operator!=(const ModInt& rhs) const;
+
+	ModInt sqr() const;
+	ModInt pow(const BigInt& exp) const;
+	//Zero if there is no inverse
+	ModInt inverse() const;
+	//Inverts every element in place with one inversion, returns the positions of those without an inverse
+	static std::vector<size_t> batchInverse(std::vector<ModInt>& xs);
+
+	friend std::ostream& operator<<(std::ostream& out, const ModInt& x);
+
+    private:
+	friend class ModRing;
+
+	const ModRing * r;
+	//In [0, m), in Montgomery form for odd moduli
+	BigInt rep;
+};
+
+/*
+ * Miller-Rabin rounds against one odd n > 4 sharing their setup: n - 1 = d 2^s, the ModRing of n and
+ * the sliding window recoding of d are worked out once, so each witness costs its window table, one
+ * pass over the recoded exponent and at most s - 1 squarings. Witnesses are run LANES at a time in
+ * lockstep, their independent products giving the processor something to overlap.
+ */
+class MillerRabinTester {
+    public:
+	static const size_t LANES = 4;
+
+	explicit MillerRabinTester(const BigInt& n);
+
+	//True if n is a strong probable prime to every witness
+	bool test(const BigInt& witness) const;
+	bool test(const std::vector<BigInt>& witnesses) const;
+	//k witnesses drawn uniformly from [2, n - 2]
+	bool testRandom(int k, RandomGenerator& rng) const;
+
+    private:
+	//squarings then a multiplication by the odd power digit of the witness, none for digit 0
+	struct Window {
+	    size_t squarings;
+	    limb_t digit;
+	};
+
+	bool finish(ModInt x) const;
+
+	BigInt n;
+	ModRing ring;
+	BigInt d;
+	size_t s;
+	int window_bits;
+	std::vector<Window> windows;
+	ModInt one;
+	ModInt minus_one;
+};
+
+#endif
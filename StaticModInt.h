@@ -0,0 +1,332 @@
+#ifndef _StaticModInt
+#define _StaticModInt
+#include "FixedBigInt.h"
+#include <type_traits>
+
+/*
+ * Residues mod a modulus fixed at compile time. The modulus comes from a Field type with a _big literal,
+ *
+ *     struct Curve25519 { static constexpr auto& modulus = 0x7fff...ffed_big; };
+ *     typedef StaticModInt<Curve25519> Fe;
+ *
+ * and sizes the FixedBigInt holding a residue. Moduli 2^k - c with c of at most two limbs are reduced
+ * by folding the bits above 2^k back in multiplied by c, every other odd modulus by Montgomery
+ * multiplication with the constant worked out at compile time. Folding branches on the value,
+ * Montgomery products do not.
+ */
+
+template<size_t N>
+constexpr size_t literalBitLength(const BigLiteral<N>& m) {
+    size_t bits = 31 * (m.used - 1);
+    for(limb_t top = m.limbs[m.used - 1]; top != 0; top >>= 1) {
+	++bits;
+    }
+    return bits;
+}
+
+//2^k - m for m < 2^k
+template<size_t N>
+constexpr BigLiteral<N> literalComplement(const BigLiteral<N>& m, size_t k) {
+    BigLiteral<N> c{};
+    limb_t carry = 1;
+    for(size_t i = 0; i < N; ++i) {
+	size_t low = 31 * i;
+	limb_t ones = low >= k ? 0 : k - low >= 31 ? 0x7fffffff : (static_cast<limb_t>(1) << (k - low)) - 1;
+	limb_t t = ones - m.limbs[i] + carry;
+	c.limbs[i] = t & 0x7fffffff;
+	carry = t >> 31;
+    }
+    c.used = N;
+    while(c.used > 1 && c.limbs[c.used - 1] == 0) {
+	--c.used;
+    }
+    return c;
+}
+
+//-m0^-1 mod 2^31 for odd m0, as in BigInt::montInverse
+constexpr limb_t literalMontInverse(limb_t m0) {
+    limb_t inv = m0;
+    for(int i = 0; i < 5; ++i) {
+	inv *= 2 - m0 * inv;
+    }
+    return (0 - inv) & 0x7fffffff;
+}
+
+template<class Field>
+class StaticModInt {
+	typedef typename std::decay<decltype(Field::modulus)>::type Literal;
+
+    public:
+	static constexpr size_t BITS = literalBitLength(Field::modulus);
+	typedef FixedBigInt<BITS> Int;
+	static const size_t LIMBS = Int::LIMBS;
+
+	//m = 2^BITS - C
+	static constexpr Literal C = literalComplement(Field::modulus, BITS);
+	static constexpr bool PSEUDO_MERSENNE = C.used <= 2 && BITS >= 62 * C.used + 31;
+	static constexpr Int MOD = Int(Field::modulus);
+	static constexpr limb_t INV = literalMontInverse(Field::modulus.limbs[0]);
+
+	static_assert(PSEUDO_MERSENNE || (Field::modulus.limbs[0] & 1) == 1, "Montgomery reduction needs an odd modulus");
+
+	StaticModInt(): rep() {}
+
+	//x mod m, x can be negative or unreduced
+	explicit StaticModInt(const BigInt& x): rep(toRep(x, Strategy())) {}
+
+	static StaticModInt zero() {
+	    return StaticModInt();
+	}
+
+	static StaticModInt one() {
+	    static const StaticModInt value(BigInt::ONE);
+	    return value;
+	}
+
+	static BigInt modulus() {
+	    return MOD.toBigInt();
+	}
+
+	BigInt value() const {
+	    return fromRep(rep, Strategy());
+	}
+
+	bool isZero() const {
+	    return rep.isZero();
+	}
+
+	StaticModInt& operator+=(const StaticModInt& rhs) {
+	    Int diff;
+	    limb_t carry = rep.add(rhs.rep);
+	    diff = rep;
+	    limb_t borrow = diff.sub(MOD);
+	    //The sum is below m exactly when subtracting m borrows and the addition did not carry
+	    select(rep, diff, (borrow & (carry ^ 1)) ^ 1);
+	    return *this;
+	}
+
+	StaticModInt& operator-=(const StaticModInt& rhs) {
+	    Int sum;
+	    limb_t borrow = rep.sub(rhs.rep);
+	    sum = rep;
+	    sum.add(MOD);
+	    select(rep, sum, borrow);
+	    return *this;
+	}
+
+	StaticModInt& operator*=(const StaticModInt& rhs) {
+	    rep = mul(rep, rhs.rep, Strategy());
+	    return *this;
+	}
+
+	StaticModInt operator+(const StaticModInt& rhs) const {
+	    StaticModInt tmp(*this);
+	    return tmp += rhs;
+	}
+
+	StaticModInt operator-(const StaticModInt& rhs) const {
+	    StaticModInt tmp(*this);
+	    return tmp -= rhs;
+	}
+
+	StaticModInt operator*(const StaticModInt& rhs) const {
+	    StaticModInt tmp(*this);
+	    return tmp *= rhs;
+	}
+
+	StaticModInt operator-() const {
+	    return zero() - *this;
+	}
+
+	bool operator==(const StaticModInt& rhs) const {
+	    return rep == rhs.rep;
+	}
+
+	bool operator!=(const StaticModInt& rhs) const {
+	    return rep != rhs.rep;
+	}
+
+	StaticModInt sqr() const {
+	    StaticModInt tmp;
+	    tmp.rep = square(rep, Strategy());
+	    return tmp;
+	}
+
+	//4 bit fixed windows from the top of exp
+	StaticModInt pow(const BigInt& exp) const {
+	    StaticModInt table[16];
+	    table[0] = one();
+	    for(int i = 1; i < 16; ++i) {
+		table[i] = table[i - 1] * *this;
+	    }
+	    StaticModInt acc = one();
+	    size_t windows = (exp.bitLength() + 3) / 4;
+	    for(size_t w = windows; w-- > 0;) {
+		for(int i = 0; i < 4; ++i) {
+		    acc = acc.sqr();
+		}
+		int digit = 0;
+		for(int i = 3; i >= 0; --i) {
+		    digit = (digit << 1) | exp.testBit(4 * w + i);
+		}
+		acc *= table[digit];
+	    }
+	    return acc;
+	}
+
+	//Zero if there is no inverse
+	StaticModInt inverse() const {
+	    return StaticModInt(value().mod_inv(modulus()));
+	}
+
+    private:
+	typedef std::integral_constant<bool, PSEUDO_MERSENNE> Strategy;
+
+	//Montgomery form for general moduli, plain residues for pseudo-Mersenne ones, in [0, m) either way
+	Int rep;
+
+	static const Int& r2() {
+	    static const Int value((BigInt::ONE << (2 * Int::LIMB_BITS * LIMBS)) % modulus());
+	    return value;
+	}
+
+	static BigInt reduce(const BigInt& x) {
+	    BigInt reduced = x % modulus();
+	    if(reduced.negative && !reduced.isZero()) {
+		reduced += modulus();
+	    }
+	    return reduced;
+	}
+
+	static Int toRep(const BigInt& x, std::true_type) {
+	    return Int(reduce(x));
+	}
+
+	static Int toRep(const BigInt& x, std::false_type) {
+	    return Int::montMul(Int(reduce(x)), r2(), MOD, INV);
+	}
+
+	static BigInt fromRep(const Int& x, std::true_type) {
+	    return x.toBigInt();
+	}
+
+	static BigInt fromRep(const Int& x, std::false_type) {
+	    return Int::montMul(x, Int(1), MOD, INV).toBigInt();
+	}
+
+	static Int mul(const Int& a, const Int& b, std::true_type) {
+	    return fold(a.mul(b));
+	}
+
+	static Int mul(const Int& a, const Int& b, std::false_type) {
+	    return Int::montMul(a, b, MOD, INV);
+	}
+
+	static Int square(const Int& a, std::true_type) {
+	    return fold(a.sqr());
+	}
+
+	static Int square(const Int& a, std::false_type) {
+	    return Int::montMul(a, a, MOD, INV);
+	}
+
+	/*
+	 * x = lo + 2^BITS hi is congruent to lo + C hi, repeated until nothing is left above 2^BITS, after which
+	 * x < 2^BITS = m + C needs at most one subtraction of m. Each pass shrinks x by about BITS - 31 * C.used bits.
+	 */
+	static Int fold(typename Int::Wide x) {
+	    //The first pass has a constant length, so it is unrolled
+	    size_t n = foldStep(x.limbs, Int::Wide::LIMBS);
+	    while(n != 0) {
+		n = foldStep(x.limbs, n);
+	    }
+
+	    Int result, diff;
+	    std::copy(x.limbs.begin(), x.limbs.begin() + LIMBS, result.limbs.begin());
+	    diff = result;
+	    limb_t borrow = diff.sub(MOD);
+	    select(result, diff, borrow ^ 1);
+	    return result;
+	}
+
+	//One pass over the low n limbs of x, returns how many limbs x can have after it or 0 if there was nothing to fold
+	static size_t foldStep(std::array<limb_t, Int::Wide::LIMBS>& x, size_t n) {
+	    const size_t W = Int::Wide::LIMBS;
+	    const size_t q = BITS / Int::LIMB_BITS;
+	    const int r = BITS % Int::LIMB_BITS;
+	    const limb_t mask = Int::MASK;
+	    if(n <= q) {
+		return 0;
+	    }
+	    const size_t h = n - q;
+	    std::array<limb_t, W> hi;
+	    limb_t any = 0;
+	    for(size_t i = 0; i < h; ++i) {
+		limb_t v = x[q + i] >> r;
+		if(q + i + 1 < n) {
+		    v |= (x[q + i + 1] << (Int::LIMB_BITS - r)) & mask;
+		}
+		hi[i] = v;
+		any |= v;
+	    }
+	    if(any == 0) {
+		return 0;
+	    }
+	    x[q] &= (static_cast<limb_t>(1) << r) - 1;
+	    for(size_t i = q + 1; i < n; ++i) {
+		x[i] = 0;
+	    }
+
+	    //lo + C hi fits in one limb more than the larger of the two
+	    const size_t next = std::min(W, std::max(q + 1, h + C.used) + 1);
+	    for(size_t j = 0; j < C.used; ++j) {
+		limb_t carry = 0;
+		size_t i = j;
+		for(; i < h + j; ++i) {
+		    limb_t t = x[i] + hi[i - j] * C.limbs[j] + carry;
+		    x[i] = t & mask;
+		    carry = t >> Int::LIMB_BITS;
+		}
+		for(; carry != 0 && i < next; ++i) {
+		    limb_t t = x[i] + carry;
+		    x[i] = t & mask;
+		    carry = t >> Int::LIMB_BITS;
+		}
+	    }
+	    return next;
+	}
+
+	//a = b if pick_b is 1, a is left alone if it is 0
+	static void select(Int& a, const Int& b, limb_t pick_b) {
+	    limb_t take = 0 - pick_b;
+	    for(size_t i = 0; i < LIMBS; ++i) {
+		a.limbs[i] = (a.limbs[i] & ~take) | (b.limbs[i] & take);
+	    }
+	}
+};
+
+template<class Field> constexpr size_t StaticModInt<Field>::BITS;
+template<class Field> const size_t StaticModInt<Field>::LIMBS;
+template<class Field> constexpr typename StaticModInt<Field>::Literal StaticModInt<Field>::C;
+template<class Field> constexpr bool StaticModInt<Field>::PSEUDO_MERSENNE;
+template<class Field> constexpr typename StaticModInt<Field>::Int StaticModInt<Field>::MOD;
+template<class Field> constexpr limb_t StaticModInt<Field>::INV;
+
+//Standard moduli
+struct Curve25519Field {
+    static constexpr auto& modulus = 0x7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffed_big;
+};
+
+struct Secp256k1Field {
+    static constexpr auto& modulus = 0xfffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f_big;
+};
+
+struct P256Field {
+    static constexpr auto& modulus = 0xffffffff00000001000000000000000000000000ffffffffffffffffffffffff_big;
+};
+
+struct P521Field {
+    static constexpr auto& modulus = 0x1ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff_big;
+};
+
+#endif
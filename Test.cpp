@@ -1,5 +1,9 @@
 #include "BigInt.h"
+#include "FixedBigInt.h"
+#include "ModInt.h"
+#include "StaticModInt.h"
 #include <chrono>
+#include <cmath>
 
 BigInt Fibonacci(int n) {
     BigInt fibs[3];
@@ -431,6 +435,64 @@ void test512ModExp() {
   
 }
 
+void testConstTimeModExp() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt p("90920301086832428064790445863602542431397528935205269974512244031053835934561");
+    BigInt q("88093521957739528656999318948821526825072711349854666270556593711408857684143");
+    BigInt n(p * q);
+    BigInt d("61209282410124760555153387834751911935998153976979367427081753749948289104979274"
+	     "79612549027573377098818014420611341932265518557602531048137183493875578113");
+    BigInt m = BigInt(2).pow(128);
+    BigInt c = m.pow(BigInt(65537), n);
+
+    start = std::chrono::system_clock::now();
+    BigInt m2 = c.pow_ct(d, n);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testConstTimeModExp took: " << elapsed_time.count() << " computing " << m2 << std::endl;
+
+    //Latency spread over exponents of the same size but very different weight
+    const int trials = 40;
+    for(int ct = 0; ct < 2; ++ct) {
+	double sum = 0, sum_sq = 0, lo = 1e9, hi = 0;
+	for(int i = 0; i < trials; ++i) {
+	    BigInt e = (i % 2) ? BigInt::genRandomNum(n) : BigInt(2).pow(510) + BigInt(i);
+	    start = std::chrono::system_clock::now();
+	    BigInt r = ct ? c.pow_ct(e, n) : c.pow(e, n);
+	    end = std::chrono::system_clock::now();
+	    double t = std::chrono::duration<double>(end - start).count();
+	    sum += t;
+	    sum_sq += t * t;
+	    lo = std::min(lo, t);
+	    hi = std::max(hi, t);
+	}
+	double mean = sum / trials;
+	std::cout << (ct ? "pow_ct" : "pow") << " 512 bit latency mean: " << mean << " stddev: "
+	    << std::sqrt(sum_sq / trials - mean * mean) << " min: " << lo << " max: " << hi << std::endl;
+    }
+#endif
+    std::cout << "512 RSA constant-time Decrypt Correct? " << (m2 == m) << std::endl;
+    std::cout << "Constant-time even modulus Correct? " << (BigInt(3).pow_ct(BigInt(100), BigInt(1000)) == BigInt(1)) << std::endl;
+
+    //Even 2^k - c, where the products reduce by folding
+    RandomGenerator rng(30);
+    BigInt even = (BigInt::ONE << 1291) - BigInt(static_cast<limb_t>(2125652800));
+    std::vector<BigInt> bases, exps;
+    bool folded = true;
+    for(int i = 0; i < 6; ++i) {
+	bases.push_back(BigInt::genRandomBits(1054, rng));
+	exps.push_back(BigInt::genRandomBits(473, rng));
+	folded &= bases[i].pow_ct(exps[i], even) == bases[i].pow(exps[i], even);
+    }
+    std::vector<BigInt> batch = BigInt::powBatch(bases, exps, even);
+    for(int i = 0; i < 6; ++i) {
+	folded &= batch[i] == bases[i].pow(exps[i], even);
+    }
+    std::cout << "Constant-time even 2^k - c Correct? " << folded << std::endl;
+}
+
 void test4kModExp() {
     std::chrono::time_point<std::chrono::system_clock> start, end;
     std::chrono::duration<double> elapsed_time;
@@ -457,6 +519,370 @@ void test4kModExp() {
 }
 
 
+void testPowBatch() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    RandomGenerator rng(49);
+    std::vector<BigInt> bases, exps, mods;
+    BigInt m512 = BigInt::genRandomBits(512, rng), m1024 = Fibonacci(1500);
+    m512.setBit(0);
+    m1024.setBit(0);
+    for(int i = 0; i < 11; ++i) {
+        mods.push_back(i % 3 == 0 ? m512 : m1024);
+        bases.push_back(BigInt::genRandomBits(600, rng));
+        exps.push_back(BigInt::genRandomBits(40 * i + 1, rng));
+    }
+    bases[4] = -bases[4];
+    exps[5] = BigInt::ZERO;
+    //An even modulus and a negative exponent are handled on their own
+    mods[7] = m1024 + BigInt::ONE;
+    exps[9] = -exps[9];
+
+    std::vector<BigInt> expected;
+    for(int i = 0; i < 11; ++i) {
+        expected.push_back(bases[i].pow_ct(exps[i], mods[i]));
+    }
+
+    BigInt::MulKernel original = BigInt::mulKernel();
+    bool agree = true;
+    start = std::chrono::system_clock::now();
+    for(auto k : {BigInt::MulKernel::SCALAR, BigInt::MulKernel::AVX2, BigInt::MulKernel::AVX512}) {
+        if(BigInt::setMulKernel(k)) {
+            agree &= BigInt::powBatch(bases, exps, mods) == expected;
+        }
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+    BigInt::setMulKernel(original);
+#ifdef _PRINT_VALS
+    std::cout<< "testPowBatch took: " << elapsed_time.count() << " for each kernel on 11 exponentiations" << std::endl;
+#endif
+
+    std::vector<BigInt> shared = BigInt::powBatch({BigInt(3), BigInt(5)}, {BigInt(100), BigInt(200)}, m512);
+    std::cout << "powBatch Correct? " << (agree && shared[0] == BigInt(3).pow(BigInt(100), m512)
+                                          && shared[1] == BigInt(5).pow(BigInt(200), m512)) << std::endl;
+}
+
+void testPow2Mod() {
+    BigInt m = Fibonacci(1200) + BigInt::ONE, e = Fibonacci(1100);
+    BigInt even = m - BigInt::ONE;
+    std::cout << "pow2mod Correct? " << (BigInt::pow2mod(e, m) == BigInt::TWO.pow(e, m) && BigInt::pow2mod(e, even) == BigInt::TWO.pow(e, even)
+                                         && BigInt::pow2mod(BigInt::ZERO, m) == BigInt::ONE && BigInt::pow2mod(BigInt(700), m) == BigInt::TWO.pow(700)) << std::endl;
+}
+
+void testShifts() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt x = Fibonacci(1000);
+    BigInt p2_37 = BigInt(2).pow(37);
+
+    start = std::chrono::system_clock::now();
+    BigInt left = x << 37;
+    BigInt right = left >> 37;
+    BigInt fused(x);
+    fused.subShifted(x, 100);
+    fused.addShifted(x, 100);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testShifts took: " << elapsed_time.count() << " computing " << left << std::endl;
+#endif
+    std::cout << "F(1000) << 37 Correct? " << (left == x * p2_37) << std::endl;
+    std::cout << "(F(1000) << 37) >> 37 Correct? " << (right == x) << std::endl;
+    std::cout << "F(1000) >> 700 Correct? " << ((x >> 700) == x / BigInt(2).pow(700)) << std::endl;
+    std::cout << "Shift-add Correct? " << (fused == x) << std::endl;
+}
+
+void testBitQueries() {
+    BigInt x = BigInt(3) << 100;
+    BigInt y(x);
+    y.setBit(5).clearBit(100);
+
+    std::cout << "bitLength Correct? " << (x.bitLength() == 102 && BigInt::ZERO.bitLength() == 0) << std::endl;
+    std::cout << "countTrailingZeros Correct? " << (x.countTrailingZeros() == 100) << std::endl;
+    std::cout << "popcount Correct? " << (x.popcount() == 2 && Fibonacci(100).popcount() == 41) << std::endl;
+    std::cout << "testBit Correct? " << (x.testBit(101) && !x.testBit(99) && !x.testBit(1000)) << std::endl;
+    std::cout << "setBit/clearBit Correct? " << (y == (BigInt(1) << 101) + BigInt(32)) << std::endl;
+    std::cout << "isOdd/isZero/sign Correct? " << (!x.isOdd() && y.isZero() == false && (-x).sign() == -1 && BigInt::ZERO.sign() == 0) << std::endl;
+}
+
+void testAddMul() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    RandomGenerator rng(40);
+    std::vector<BigInt> xs, ys;
+    for(int i = 0; i < 16; ++i) {
+        xs.push_back(BigInt::genRandomBits(40 * (i + 1), rng));
+        ys.push_back(BigInt::genRandomBits(1000 - 50 * i, rng));
+        if(i % 3 == 0) {
+            ys.back() = -ys.back();
+        }
+    }
+
+    start = std::chrono::system_clock::now();
+    BigInt dot, expected;
+    for(int i = 0; i < 16; ++i) {
+        dot.addmul(xs[i], ys[i]);
+        expected += xs[i] * ys[i];
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testAddMul took: " << elapsed_time.count() << " computing " << dot << std::endl;
+#endif
+
+    BigInt x = Fibonacci(1000), y = Fibonacci(999);
+    BigInt small(x);
+    small.submul(y, x);
+    BigInt word(x);
+    word.addmul_1(y, 12345).submul_1(x, 7);
+
+    std::cout << "addmul dot product Correct? " << (dot == expected) << std::endl;
+    std::cout << "submul sign change Correct? " << (small == x - y * x) << std::endl;
+    std::cout << "addmul_1/submul_1 Correct? " << (word == y * BigInt(12345) - BigInt(6) * x) << std::endl;
+}
+
+void testMulKernels() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    RandomGenerator rng(48);
+    std::vector<BigInt> xs;
+    for(size_t limbs = 1; limbs <= 80; limbs += 3) {
+        xs.push_back(BigInt::genRandomBits(31 * limbs, rng));
+        //All ones limbs give the largest column sums
+        xs.push_back((BigInt::ONE << (31 * limbs)) - BigInt::ONE);
+    }
+
+    BigInt::MulKernel original = BigInt::mulKernel();
+    BigInt::setMulKernel(BigInt::MulKernel::SCALAR);
+    std::vector<BigInt> expected;
+    for(size_t i = 0; i < xs.size(); ++i) {
+        expected.push_back(xs[i].naiveMul(xs[i], xs[(i * 7 + 3) % xs.size()]));
+        expected.push_back(xs[i].naiveMul(xs[i], xs[i]));
+    }
+
+    bool agree = true;
+    int kernels = 0;
+    start = std::chrono::system_clock::now();
+    for(auto k : {BigInt::MulKernel::AVX2, BigInt::MulKernel::AVX512}) {
+        if(!BigInt::setMulKernel(k)) {
+            continue;
+        }
+        ++kernels;
+        for(size_t i = 0; i < xs.size(); ++i) {
+            agree &= xs[i].naiveMul(xs[i], xs[(i * 7 + 3) % xs.size()]) == expected[2 * i];
+            agree &= xs[i].naiveMul(xs[i], xs[i]) == expected[2 * i + 1];
+        }
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+    BigInt::setMulKernel(original);
+#ifdef _PRINT_VALS
+    std::cout<< "testMulKernels took: " << elapsed_time.count() << " checking " << kernels << " vector kernels" << std::endl;
+#endif
+
+    std::cout << "Vector mul kernels Correct? " << agree << std::endl;
+}
+
+void testGcd() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    //gcd(F(m), F(n)) = F(gcd(m, n))
+    BigInt fib500 = Fibonacci(500);
+    BigInt fib300 = Fibonacci(300);
+    BigInt fib20000 = Fibonacci(20000);
+    BigInt fib15000 = Fibonacci(15000);
+    start = std::chrono::system_clock::now();
+    BigInt small = fib500.gcd(fib300);
+    BigInt large = fib20000.gcd(fib15000);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testGcd took: " << elapsed_time.count() << " computing " << small << std::endl;
+#endif
+    std::cout << "gcd(F(500), F(300)) Correct? " << (small == Fibonacci(100)) << std::endl;
+    std::cout << "gcd(F(20000), F(15000)) Correct? " << (large == Fibonacci(5000)) << std::endl;
+    std::cout << "gcd(-12, 18) Correct? " << (BigInt(-12).gcd(18) == BigInt(6)) << std::endl;
+
+    //Past the half-gcd threshold of 32000 limbs: gcd(g 2^k, g x) = g for odd g and x
+    RandomGenerator rng(27);
+    const size_t bits = 31 * 32500;
+    BigInt g = BigInt::genRandomBits(31 * 1000, rng);
+    BigInt x = BigInt::genRandomBits(bits, rng);
+    g.setBit(0);
+    x.setBit(0);
+    BigIntStats::reset();
+    start = std::chrono::system_clock::now();
+    BigInt huge = (g << bits).gcd(g * x);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "half-gcd took: " << elapsed_time.count() << std::endl;
+#endif
+    bool correct = huge == g;
+    if(BigIntStats::enabled()) {
+	correct &= BigIntStats::snapshot()[BigIntStats::HALF_GCD].calls > 1;
+    }
+    std::cout << "Half-gcd Correct? " << correct << std::endl;
+}
+
+void testModInv() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt e(65537);
+    BigInt p("90920301086832428064790445863602542431397528935205269974512244031053835934561");
+    BigInt q("88093521957739528656999318948821526825072711349854666270556593711408857684143");
+    BigInt n(p * q);
+    BigInt phi((p - BigInt::ONE) * (q - BigInt::ONE));
+
+    start = std::chrono::system_clock::now();
+    BigInt d = e.mod_inv(phi);
+    BigInt q_inv = q.mont_inv(p);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testModInv took: " << elapsed_time.count() << " computing " << d << std::endl;
+#endif
+    BigInt actual("61209282410124760555153387834751911935998153976979367427081753749948289104979274"
+	     "79612549027573377098818014420611341932265518557602531048137183493875578113");
+    std::cout << "65537^-1 mod phi(n) Correct? " << (d == actual) << std::endl;
+
+    //q is taken to be in Montgomery form, so q * q_inv = R^2 mod p
+    BigInt r2 = BigInt::ONE;
+    r2.lLimbShift(2 * p.size());
+    std::cout << "Montgomery inverse Correct? " << (q.mod_mul(q_inv, p) == r2 % p) << std::endl;
+    std::cout << "Non-invertible Correct? " << (p.mod_inv(n) == BigInt::ZERO) << std::endl;
+}
+
+void testBatchModInv() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt p("90920301086832428064790445863602542431397528935205269974512244031053835934561");
+    std::vector<BigInt> xs;
+    for(int i = 0; i < 1000; ++i) {
+	xs.push_back(BigInt::genRandomNum(p));
+    }
+    xs[10] = BigInt::ZERO;
+    xs[500] = p * BigInt::TWO;
+    std::vector<BigInt> inputs(xs);
+
+    start = std::chrono::system_clock::now();
+    std::vector<size_t> bad = BigInt::batchModInv(xs, p);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testBatchModInv took: " << elapsed_time.count() << " for " << xs.size() << " inverses" << std::endl;
+#endif
+    bool correct = true;
+    for(size_t i = 0; i < xs.size(); ++i) {
+	correct &= xs[i] == inputs[i].mod_inv(p);
+    }
+    std::cout << "Batch inverse Correct? " << correct << std::endl;
+    std::cout << "Batch inverse failures Correct? " << (bad == std::vector<size_t>{10, 500}) << std::endl;
+}
+
+void testModAddSub() {
+    BigInt m = BigInt(2).pow(127) - BigInt(1);
+    BigInt a = Fibonacci(180) % m, b = Fibonacci(181) % m;
+    BigInt x(a);
+    x.addReduced(b, m).subReduced(a, m).doubleReduced(m).negReduced(m);
+
+    std::cout << "mod_add/mod_sub Correct? " << (a.mod_add(b, m) == (a + b) % m && a.mod_sub(b, m) == m - (b - a)
+                                                   && b.mod_add(-a, m) == (b - a) % m) << std::endl;
+    std::cout << "mod_neg/mod_double Correct? " << (a.mod_neg(m) == m - a && BigInt::ZERO.mod_neg(m) == BigInt::ZERO
+                                                       && b.mod_double(m) == (b + b) % m) << std::endl;
+    std::cout << "Reduced in place Correct? " << (x == m - (b + b) % m) << std::endl;
+    std::cout << "Negative multiple mod Correct? " << ((-(m * BigInt(3))) % m == BigInt::ZERO) << std::endl;
+}
+
+void testSpecialFormMod() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt m1279 = BigInt::TWO.pow(1279) - BigInt::ONE;
+    BigInt minus = BigInt::TWO.pow(700) - BigInt(12345), plus = BigInt::TWO.pow(700) + BigInt(12345);
+    BigInt q = Fibonacci(1500), r = Fibonacci(900);
+
+    start = std::chrono::system_clock::now();
+    BigInt fermat = BigInt(3).pow(m1279 - BigInt::ONE, m1279);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testSpecialFormMod took: " << elapsed_time.count() << " computing " << fermat << std::endl;
+#endif
+
+    std::cout << "Mersenne modexp Correct? " << (fermat == BigInt::ONE) << std::endl;
+    std::cout << "2^k - c, 2^k + c mod Correct? " << ((q * minus + r) % minus == r && (q * plus + r) % plus == r
+                                                         && (-(q * plus) - r) % plus == plus - r) << std::endl;
+    std::cout << "2^k mod Correct? " << (q % BigInt::TWO.pow(1000) == q - ((q >> 1000) << 1000)) << std::endl;
+
+    //Folding against division on products from the multiplication routines, which are what it reduces in practice
+    RandomGenerator rng(44);
+    auto divMod = [](const BigInt& x, const BigInt& m) {
+	return x - (x / m) * m;
+    };
+    bool folds = true, pows = true;
+    for(int i = 0; i < 60; ++i) {
+	size_t k = 620 + rng.next() % 3000;
+	BigInt c(static_cast<limb_t>(1 + rng.next() % 0x7fffffff));
+	BigInt m = i % 3 == 0 ? (BigInt::ONE << k) + c : (BigInt::ONE << k) - c;
+	BigInt a = BigInt::genRandomNum(m, rng), b = BigInt::genRandomNum(m, rng);
+	//Mostly ones, where carries run furthest
+	if(i % 4 == 1) {
+	    a = m - BigInt::ONE - BigInt(static_cast<limb_t>(rng.next()));
+	}
+	folds &= (a * b) % m == divMod(a * b, m) && (a * a) % m == divMod(a * a, m);
+
+	if(i % 10 == 0) {
+	    BigInt e = BigInt::genRandomBits(130, rng), acc = BigInt::ONE, sq = divMod(-a, m) + m;
+	    for(size_t j = 0; j < e.bitLength(); ++j) {
+		if(e.testBit(j)) {
+		    acc = divMod(acc * sq, m);
+		}
+		sq = divMod(sq * sq, m);
+	    }
+	    pows &= (-a).pow(e, m) == acc && (-a).pow_ct(e, m) == acc;
+	}
+    }
+    std::cout << "Special form fold vs division Correct? " << folds << std::endl;
+    std::cout << "Special form modexp Correct? " << pows << std::endl;
+}
+
+void testModInt() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt m = BigInt(2).pow(521) - BigInt(1);
+    BigInt a = Fibonacci(700), b = Fibonacci(701);
+    ModRing ring(m), even(m + BigInt(1));
+
+    start = std::chrono::system_clock::now();
+    //Horner evaluation of 1 + 2x + ... + 50x^49 at a
+    ModInt x = ring(a), poly = ring.zero();
+    for(int i = 50; i > 0; --i) {
+        poly = poly * x + ring(BigInt(i));
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testModInt took: " << elapsed_time.count() << " computing " << poly << std::endl;
+#endif
+    BigInt expected = BigInt::ZERO;
+    for(int i = 50; i > 0; --i) {
+        expected = (expected * (a % m) + BigInt(i)) % m;
+    }
+
+    std::vector<ModInt> xs{ring(a), ring.zero(), ring(-b)};
+    std::vector<size_t> bad = ModInt::batchInverse(xs);
+    ModInt y = even(b);
+
+    std::cout << "ModInt Horner Correct? " << (poly.value() == expected) << std::endl;
+    std::cout << "ModInt ops Correct? " << ((x - ring(b)).value() == (a - b) % m && (-x).value() == m - a % m
+                                             && (y * even(a) - y.sqr()).value() == (b * a - b * b) % (m + BigInt(1))) << std::endl;
+    std::cout << "ModInt pow/inverse Correct? " << (x.pow(b) == ring(a.pow(b, m)) && (x * x.inverse()) == ring.one()
+                                                     && x.pow(-BigInt(3)) * x.pow(BigInt(3)) == ring.one()) << std::endl;
+    std::cout << "ModInt batchInverse Correct? " << (bad == std::vector<size_t>{1} && xs[0] == x.inverse()
+                                                        && xs[2] * ring(-b) == ring.one()) << std::endl;
+}
+
 void testRandomBitsGeneration() {
     auto num = BigInt::genRandomBits(512);
 
@@ -464,6 +890,35 @@ void testRandomBitsGeneration() {
     std::cout << "testRandomBitsGeneration correct? " << (BigInt::log2(num) <= 512) << std::endl;
 }
 
+void testSeededRandom() {
+    RandomGenerator a(2024), b(2024);
+    BigInt high = (BigInt(3) << 300) + BigInt(7);
+    bool same = true, in_range = true;
+    for(int i = 0; i < 100; ++i) {
+	BigInt x = BigInt::genRandomNum(high, a);
+	same &= x == BigInt::genRandomNum(high, b);
+	in_range &= x < high && !x.negative;
+    }
+    std::cout << "Seeded random reproducible Correct? " << same << std::endl;
+    std::cout << "Random range Correct? " << in_range << std::endl;
+
+    //RFC 7539 2.3.2: its 32 bit counter and 96 bit nonce are the same state words as our 64 bit ones
+    uint32_t key[8];
+    for(int i = 0; i < 8; ++i) {
+	key[i] = 0x03020100 + 0x04040404 * i;
+    }
+    RandomGenerator chacha(key, 0x4a000000, 0x0900000000000001ULL);
+    const uint32_t expected[16] = {
+	0xe4e7f110, 0x15593bd1, 0x1fdd0f50, 0xc47120a3, 0xc7f4d1c7, 0x0368c033, 0x9aaa2204, 0x4e6cd4c3,
+	0x466482d2, 0x09aa9f07, 0x05d7c214, 0xa2028bd9, 0xd19c12b5, 0xb94e16de, 0xe883d0cb, 0x4e3c50a2
+    };
+    bool block = true;
+    for(auto word : expected) {
+	block &= chacha.next() == word;
+    }
+    std::cout << "ChaCha20 block Correct? " << block << std::endl;
+}
+
 void testIsLikelyPrime() {
     BigInt num{3413};
 
@@ -481,6 +936,68 @@ void testIsLikelyPrime() {
 
 }
 
+void testMillerRabinTester() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt p = BigInt::TWO.pow(521) - BigInt::ONE;
+    BigInt composite = (BigInt::TWO.pow(127) - BigInt::ONE) * (BigInt::TWO.pow(89) - BigInt::ONE);
+    MillerRabinTester prime(p), product(composite), psp(BigInt(2047));
+
+    std::vector<BigInt> witnesses;
+    for(int i = 0; i < 11; ++i) {
+        witnesses.push_back(Fibonacci(200 + i));
+    }
+    start = std::chrono::system_clock::now();
+    bool all = prime.test(witnesses);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testMillerRabinTester took: " << elapsed_time.count() << " for 11 witnesses of M521" << std::endl;
+#endif
+
+    //Each witness in a batch has to agree with the one off round
+    bool agrees = true;
+    for(auto& w : witnesses) {
+        agrees &= product.test(w) == composite.checkMillerRabinWitness(w);
+    }
+    //2047 = 23 89 is a strong pseudoprime to base 2 only
+    std::cout << "MillerRabinTester Correct? " << (all && agrees && !product.test(witnesses) && psp.test(BigInt::TWO) && !psp.test(BigInt(3))
+                                                   && !psp.test({BigInt::TWO, BigInt::TWO, BigInt::TWO, BigInt::TWO, BigInt(3)})) << std::endl;
+}
+
+void testSpecialPrimes() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    start = std::chrono::system_clock::now();
+    bool m2203 = BigInt::isLikelyPrime(BigInt::TWO.pow(2203) - BigInt::ONE);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testSpecialPrimes took: " << elapsed_time.count() << " computing M2203" << std::endl;
+#endif
+
+    std::vector<size_t> mersenne;
+    for(size_t p = 2; p < 130; ++p) {
+        if(BigInt::isMersennePrime(p)) {
+            mersenne.push_back(p);
+        }
+    }
+    bool fermat = true;
+    for(size_t m = 0; m < 10; ++m) {
+        fermat &= BigInt::isFermatPrime(m) == (m <= 4);
+    }
+    //3 2^5 + 1 = 97 and 13 2^8 + 1 = 3329 are prime, 5 2^3 + 1 = 41 too but 7 2^3 + 1 = 57 is not
+    bool proth = BigInt::isProthPrime(BigInt(3), 5) && BigInt::isProthPrime(BigInt(13), 8)
+                 && BigInt::isProthPrime(BigInt(5), 3) && !BigInt::isProthPrime(BigInt(7), 3);
+
+    std::cout << "Lucas-Lehmer Correct? " << (mersenne == std::vector<size_t>{2, 3, 5, 7, 13, 17, 19, 31, 61, 89, 107, 127}) << std::endl;
+    std::cout << "Pepin Correct? " << fermat << std::endl;
+    std::cout << "Proth Correct? " << proth << std::endl;
+    std::cout << "isLikelyPrime routing Correct? " << (m2203 && !BigInt::isLikelyPrime(BigInt::TWO.pow(2207) - BigInt::ONE)
+                                                       && BigInt::isLikelyPrime((BigInt(27) << 100) + BigInt::ONE)
+                                                          == BigInt::isProthPrime(BigInt(27), 100)) << std::endl;
+}
+
 void testGenRandomPrime() {
     auto num = BigInt::genRandomBits(1024);
 
@@ -492,6 +1009,187 @@ void testGenRandomPrime() {
 
 }
 
+void testGenProvablePrime() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    BigInt low = BigInt::TWO.pow(511);
+    BigInt high = BigInt::TWO.pow(512) - BigInt::ONE;
+    std::vector<PocklingtonStep> certificate;
+
+    start = std::chrono::system_clock::now();
+    auto prime = BigInt::genPrime(low, high, &certificate);
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout<< "testGenProvablePrime took: " << elapsed_time.count() << " computing " << prime.ToDecimal() << std::endl;
+#endif
+    bool inRange = prime >= low && prime <= high;
+    bool certified = !certificate.empty() && certificate.back().p == prime && BigInt::verifyPrimeCertificate(certificate);
+    std::cout << "genPrime 512 bit certificate Correct? " << (inRange && certified && BigInt::isLikelyPrime(prime)) << std::endl;
+
+    //A composite substituted into the chain must be rejected
+    certificate.back().p += BigInt::TWO;
+    std::cout << "genPrime tampered certificate Correct? " << !BigInt::verifyPrimeCertificate(certificate) << std::endl;
+}
+
+void testBigLiterals() {
+    //Parsed by the compiler, the limbs are usable in constant expressions
+    constexpr auto& mersenne = 0x7fff'ffff'ffff'ffff'ffff'ffff'ffff'ffff_big;
+    static_assert(mersenne.used == 5 && mersenne.limbs[0] == 0x7fffffff && mersenne.limbs[4] == 0x7, "2^127 - 1");
+    static_assert((123456789012345678901234567890_big).limbs[0] == 1312754386, "");
+    constexpr FixedBigInt<256> p256 = 0xffffffff00000001000000000000000000000000ffffffffffffffffffffffff_big;
+    static_assert(p256.limbs[0] == 0x7fffffff, "P-256");
+
+    bool correct = BigInt(mersenne) == BigInt::TWO.pow(127) - BigInt::ONE;
+    correct &= BigInt(12345678998765432101234567899876543210_big) == BigInt("12345678998765432101234567899876543210");
+    correct &= BigInt(0b1'0000'0000'0000'0000'0000'0000'0000'0000_big) == BigInt::TWO.pow(32);
+    correct &= BigInt(0777777777777777777777_big) == BigInt::TWO.pow(63) - BigInt::ONE;
+    correct &= BigInt(0_big) == BigInt::ZERO && BigInt(0x0_big).size() == 1;
+    correct &= p256.toBigInt() == BigInt::TWO.pow(256) - BigInt::TWO.pow(224) + BigInt::TWO.pow(192) + BigInt::TWO.pow(96) - BigInt::ONE;
+    //Every use of a literal refers to the same storage
+    correct &= &0x1234_big == &0x1234_big;
+    std::cout << "_big literals Correct? " << correct << std::endl;
+}
+
+template<size_t Bits>
+bool checkFixedBigInt(RandomGenerator& rng) {
+    typedef FixedBigInt<Bits> Int;
+    BigInt mod = BigInt::genRandomBits(Bits, rng).setBit(Bits - 1).setBit(0);
+    FixedMontgomery<Bits> ring(mod);
+    BigInt wrap = BigInt::ONE << (Int::LIMB_BITS * Int::LIMBS);
+    bool correct = true;
+    for(int i = 0; i < 20; ++i) {
+	BigInt a = BigInt::genRandomNum(mod, rng), b = BigInt::genRandomNum(mod, rng);
+	Int fa(a), fb(b);
+	correct &= fa.toBigInt() == a;
+	correct &= (fa + fb).toBigInt() == a + b;
+	correct &= (fa - fb).toBigInt() == (a < b ? wrap + a - b : a - b);
+	correct &= fa.mul(fb).toBigInt() == a * b && fa.sqr().toBigInt() == a * a;
+
+	typename FixedMontgomery<Bits>::Int ma = ring.toMont(a), mb = ring.toMont(b);
+	correct &= ring.fromMont(ring.mul(ma, mb)) == a.mod_mul(b, mod);
+	correct &= ring.fromMont(ring.add(ma, mb)) == a.mod_add(b, mod);
+	correct &= ring.fromMont(ring.sub(ma, mb)) == (a < b ? mod + a - b : a - b);
+	if(i < 3) {
+	    correct &= ring.fromMont(ring.pow(ma, b)) == a.pow(b, mod);
+	}
+    }
+    return correct;
+}
+
+void testFixedBigInt() {
+    RandomGenerator rng(37);
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    std::chrono::duration<double> elapsed_time;
+    bool correct = checkFixedBigInt<256>(rng) && checkFixedBigInt<521>(rng) && checkFixedBigInt<1024>(rng)
+	&& checkFixedBigInt<2048>(rng);
+    std::cout << "FixedBigInt Correct? " << correct << std::endl;
+
+    BigInt mod = BigInt::genRandomBits(256, rng).setBit(255).setBit(0);
+    FixedMontgomery<256> ring(mod);
+    FixedBigInt<256> x = ring.toMont(BigInt::genRandomNum(mod, rng));
+    BigInt y = ring.fromMont(x);
+    start = std::chrono::system_clock::now();
+    for(int i = 0; i < 100000; ++i) {
+	x = ring.sqr(x);
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout << "100000 FixedMontgomery<256> squarings took: " << elapsed_time.count() << std::endl;
+#endif
+    start = std::chrono::system_clock::now();
+    for(int i = 0; i < 100000; ++i) {
+	y = y.mod_sqr(mod);
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_time = end - start;
+#ifdef _PRINT_VALS
+    std::cout << "100000 BigInt 256 bit mod_sqr took: " << elapsed_time.count() << std::endl;
+#endif
+    std::cout << "FixedMontgomery squaring chain Correct? " << (ring.fromMont(x) == y) << std::endl;
+}
+
+//mul, sqr, add and sub in Field against BigInt %, over random residues and those next to 0, m - 1 and 2^BITS
+template<class Field>
+bool checkStaticModInt(RandomGenerator& rng) {
+    typedef StaticModInt<Field> F;
+    BigInt m = F::modulus();
+    auto reduce = [&](const BigInt& x) {
+	BigInt r = x % m;
+	return r.negative && !r.isZero() ? r + m : r;
+    };
+    std::vector<BigInt> xs{BigInt::ZERO, BigInt::ONE, BigInt::TWO, m - BigInt::ONE, m - BigInt::TWO, m >> 1, m,
+	m + BigInt::ONE, (BigInt::ONE << F::BITS) - BigInt::ONE, -(m - BigInt::ONE)};
+    for(int i = 0; i < 8; ++i) {
+	xs.push_back(BigInt::genRandomNum(m, rng));
+    }
+
+    bool correct = true;
+    for(auto& a : xs) {
+	F x(a);
+	correct &= x.sqr().value() == reduce(a * a) && x.value() == reduce(a);
+	for(auto& b : xs) {
+	    F y(b);
+	    correct &= (x * y).value() == reduce(a * b) && (x + y).value() == reduce(a + b)
+		&& (x - y).value() == reduce(a - b);
+	}
+    }
+    return correct;
+}
+
+void testStaticModInt() {
+    typedef StaticModInt<Curve25519Field> Fe;
+    typedef StaticModInt<P256Field> P256;
+    BigInt p = BigInt::TWO.pow(255) - BigInt(19);
+    BigInt a = Fibonacci(400), b = Fibonacci(401);
+
+    Fe x(a), y(b);
+    BigInt ab = (a % p) * (b % p) % p;
+    P256 u(a), v(-b);
+    BigInt q = P256::modulus();
+
+    static_assert(Fe::PSEUDO_MERSENNE && !P256::PSEUDO_MERSENNE, "");
+    static_assert(Fe::BITS == 255 && Fe::C.limbs[0] == 19 && StaticModInt<P521Field>::C.used == 1, "");
+    std::cout << "StaticModInt folding Correct? " << ((x * y).value() == ab && (x - y).value() == (a - b) % p
+                                                       && x.sqr() == x * x && (x * x.inverse()) == Fe::one()) << std::endl;
+    std::cout << "StaticModInt Montgomery Correct? " << ((u * v).value() == (a * -b) % q && (u + v).value() == (a - b) % q
+                                                          && u.pow(b) == P256(a.pow(b, q)) && (-u + u).isZero()) << std::endl;
+
+    //secp256k1 folds by a two limb C, P-521 by a one limb C on a modulus that is not a whole number of limbs
+    RandomGenerator rng(43);
+    static_assert(StaticModInt<Secp256k1Field>::PSEUDO_MERSENNE && StaticModInt<Secp256k1Field>::C.used == 2, "");
+    static_assert(StaticModInt<P521Field>::PSEUDO_MERSENNE, "");
+    std::cout << "StaticModInt secp256k1 Correct? " << checkStaticModInt<Secp256k1Field>(rng) << std::endl;
+    std::cout << "StaticModInt P-521 Correct? " << checkStaticModInt<P521Field>(rng) << std::endl;
+}
+
+void testStats() {
+    RandomGenerator rng(7);
+    BigInt a = BigInt::genRandomBits(4096, rng), b = BigInt::genRandomBits(4096, rng);
+    BigInt::genRandomBits(4096, rng);
+
+    BigIntStats::reset();
+    BigInt c = a * b;
+    BigInt d = c / a;
+    BigIntStats::Snapshot stats = BigIntStats::snapshot();
+#ifdef _PRINT_VALS
+    BigIntStats::dump(std::cout, stats);
+#endif
+    bool correct = d == b;
+    if(BigIntStats::enabled()) {
+	correct &= stats[BigIntStats::MUL_KARATSUBA].calls == 1 && stats[BigIntStats::MUL_BASECASE].calls > 1;
+	correct &= stats[BigIntStats::DIV_KNUTH].calls == 1 && stats[BigIntStats::RANDOM_BITS].calls == 0;
+    } else {
+	for(auto& s : stats) {
+	    correct &= s.calls == 0 && s.cycles == 0;
+	}
+    }
+    BigIntStats::reset();
+    correct &= BigIntStats::snapshot()[BigIntStats::MUL_KARATSUBA].calls == 0;
+    std::cout << "Instrumentation counters Correct? " << correct << std::endl;
+}
+
 
 int main() {
 
@@ -533,17 +1231,46 @@ int main() {
     testVeryLongToDecimal();
 /**/
 
+    //Shift Tests
+    testShifts();
+    testBitQueries();
+    testAddMul();
+    testMulKernels();
+
+    //GCD Tests
+    testGcd();
+    testModInv();
+    testBatchModInv();
+    testModAddSub();
+    testModInt();
+    testSpecialFormMod();
+
 /*
     //Modexp Tests
     testSmallModExp();
     test512ModExp();
     test4kModExp();
 /**/
+    testConstTimeModExp();
+    testPow2Mod();
+    testPowBatch();
+
+    //Fixed width Tests
+    testFixedBigInt();
+    testStaticModInt();
+    testBigLiterals();
 
 
 //    testRandomBitsGeneration();
+    testSeededRandom();
 //    testIsLikelyPrime();
+    testMillerRabinTester();
+    testSpecialPrimes();
     testGenRandomPrime();
+    testGenProvablePrime();
+
+    //Instrumentation
+    testStats();
 
 }
 